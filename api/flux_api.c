@@ -1,37 +1,265 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "flux_api.h"
+#include "flux_ring.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 
 static int flux_sock_fd = -1;
 static struct sockaddr_un flux_addr;
 
-static int send_request(WindowRequest *req, void *response, size_t response_size) {
+typedef struct ClientBuffer {
+    void *pixels;
+    size_t bytes;
+    struct ClientBuffer *next;
+} ClientBuffer;
+
+static flux_ring_t *flux_ring = NULL;
+static size_t flux_ring_bytes = 0;
+static int flux_ring_event_fd = -1;
+static ClientBuffer *flux_buffers = NULL;
+
+static uint32_t flux_seq = 0;
+static flux_error_fn flux_error_handler = NULL;
+static WindowReply *flux_results = NULL;
+static int flux_result_count = 0;
+static int flux_result_capacity = 0;
+static WindowReply flux_partial_reply;
+static size_t flux_partial_len = 0;
+
+static uint32_t next_seq() {
+    flux_seq++;
+
+    if (flux_seq == 0)
+        flux_seq = 1;
+
+    return flux_seq;
+}
+
+static int write_all(const void *data, size_t size) {
+    const char *bytes = data;
+
+    while (size > 0) {
+        ssize_t sent = send(flux_sock_fd, bytes, size, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return 1;
+        }
+
+        bytes += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+static flux_handle_t send_request_fds(WindowRequest *req, uint32_t flags, const int *fds, int fd_count) {
     if (flux_sock_fd == -1) {
         if (flux_init() != 0)
+            return 0;
+    }
+
+    // the compositor runs ring and socket requests in seq order, so a request that takes a
+    // seq has to be sent
+    if (fd_count < 0 || fd_count > 4)
+        return 0;
+
+    req->seq = next_seq();
+    req->flags = flags;
+
+    if (fd_count == 0 && (flags & FLUX_REQUEST_NO_REPLY) && flux_ring) {
+        bool was_empty = false;
+
+        if (flux_ring_push(flux_ring, req, &was_empty) == 0) {
+            if (was_empty)
+                eventfd_write(flux_ring_event_fd, 1);
+
+            return req->seq;
+        }
+    }
+
+    if (fd_count == 0) {
+        if (write_all(req, sizeof(*req)) != 0) {
+            printf("  EE: (flux_api.c) send_request_fds() -> failed to send request\n");
+
+            return 0;
+        }
+
+        return req->seq;
+    }
+
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    struct iovec iov = { .iov_base = req, .iov_len = sizeof(*req) };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fd_count);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fd_count);
+
+    ssize_t sent = sendmsg(flux_sock_fd, &msg, MSG_NOSIGNAL);
+
+    if (sent < 0 || write_all((char *)req + sent, sizeof(*req) - sent) != 0) {
+        printf("  EE: (flux_api.c) send_request_fds() -> failed to send request\n");
+
+        return 0;
+    }
+
+    return req->seq;
+}
+
+static flux_handle_t send_request(WindowRequest *req, uint32_t flags) {
+    return send_request_fds(req, flags, NULL, 0);
+}
+
+static void report_error(const WindowReply *reply) {
+    const char *message = reply->size > 0 ? (const char *)reply->data : "unknown error";
+
+    if (flux_error_handler)
+        flux_error_handler(reply->seq, reply->status, message);
+    else
+        printf("  EE: (flux_api.c) request %u failed -> %s\n", reply->seq, message);
+}
+
+static int store_result(const WindowReply *reply) {
+    if (flux_result_count == flux_result_capacity) {
+        int capacity = flux_result_capacity ? flux_result_capacity * 2 : 16;
+        WindowReply *grown = realloc(flux_results, capacity * sizeof(WindowReply));
+
+        if (!grown) {
+            printf("  EE: (flux_api.c) store_result() -> realloc failed\n");
+
             return 1;
+        }
+
+        flux_results = grown;
+        flux_result_capacity = capacity;
+    }
+
+    flux_results[flux_result_count++] = *reply;
+
+    return 0;
+}
+
+static int read_reply(int flags) {
+    if (flux_sock_fd == -1)
+        return -1;
+
+    while (flux_partial_len < sizeof(WindowReply)) {
+        ssize_t received = recv(flux_sock_fd, (char *)&flux_partial_reply + flux_partial_len, sizeof(WindowReply) - flux_partial_len, flags);
+
+        if (received > 0) {
+            flux_partial_len += received;
+
+            continue;
+        }
+
+        if (received == 0) {
+            printf("  EE: (flux_api.c) read_reply() -> compositor closed the connection\n");
+
+            return -1;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+
+        printf("  EE: (flux_api.c) read_reply() -> failed to receive reply\n");
+
+        return -1;
     }
 
-    ssize_t sent = send(flux_sock_fd, req, sizeof(*req), 0);
+    WindowReply *reply = &flux_partial_reply;
+
+    flux_partial_len = 0;
+
+    if (reply->size > sizeof(reply->data))
+        reply->size = sizeof(reply->data);
+
+    reply->data[sizeof(reply->data) - 1] = '\0';
 
-    if (sent != sizeof(*req)) {
-        printf("  EE: (flux_api.c) send_request() -> failed to send request\n");
+    if (reply->type == FLUX_REPLY_ERROR_EVENT) {
+        report_error(reply);
 
         return 1;
     }
 
-    if (response && response_size > 0) {
-        ssize_t received = recv(flux_sock_fd, response, response_size, 0);
+    return store_result(reply) == 0 ? 1 : -1;
+}
 
-        if (received < 0) {
-            printf("  EE: (flux_api.c) send_request() -> failed to receive response\n");
-            return 1;
+static int take_result(flux_handle_t handle, void *result, size_t size) {
+    for (int i = 0; i < flux_result_count; i++) {
+        if (flux_results[i].seq != handle)
+            continue;
+
+        WindowReply reply = flux_results[i];
+
+        flux_results[i] = flux_results[--flux_result_count];
+
+        if (reply.status != 0) {
+            report_error(&reply);
+
+            return -1;
         }
 
-        if (received < response_size)
-            ((char *)response)[received] = '\0';
+        if (result && size > 0)
+            memcpy(result, reply.data, size < reply.size ? size : reply.size);
+
+        return 1;
     }
 
     return 0;
 }
 
+static int create_shared_memory(const char *name, size_t bytes) {
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, bytes) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0) {
+        close(fd);
+
+        return -1;
+    }
+
+    return fd;
+}
+
+static void release_ring() {
+    if (flux_ring) {
+        munmap(flux_ring, flux_ring_bytes);
+
+        flux_ring = NULL;
+        flux_ring_bytes = 0;
+    }
+
+    if (flux_ring_event_fd != -1) {
+        close(flux_ring_event_fd);
+
+        flux_ring_event_fd = -1;
+    }
+}
+
 int flux_init() {
     if (flux_sock_fd != -1)
         return 0;
@@ -72,20 +300,160 @@ void flux_shutdown(unsigned long win_id) {
 
     strncpy(req.request, "SHUTDOWN", sizeof(req.request) - 1);
 
-    if (send_request(&req, NULL, 0) < 0) {
+    release_ring();
+
+    // the local side is torn down even when the compositor can no longer be told
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0)
         printf("  EE: (flux_api.c) flux_shutdown() -> failed to close connection to compositor\n");
 
-        return;
+    if (flux_sock_fd != -1)
+        close(flux_sock_fd);
+
+    flux_sock_fd = -1;
+    flux_partial_len = 0;
+    flux_result_count = 0;
+
+    while (flux_buffers)
+        flux_destroy_buffer(flux_buffers->pixels);
+}
+
+void flux_set_error_handler(flux_error_fn handler) {
+    flux_error_handler = handler;
+}
+
+uint32_t flux_last_seq() {
+    return flux_seq;
+}
+
+int flux_wait(flux_handle_t handle, void *result, size_t size) {
+    if (handle == 0)
+        return 1;
+
+    while (1) {
+        int status = take_result(handle, result, size);
+
+        if (status != 0)
+            return status < 0;
+
+        if (read_reply(0) < 0)
+            return 1;
     }
+}
 
-    close(flux_sock_fd);
+int flux_poll(flux_handle_t handle, void *result, size_t size) {
+    if (handle == 0)
+        return -1;
 
-    flux_sock_fd = -1;
+    while (1) {
+        int status = take_result(handle, result, size);
+
+        if (status != 0)
+            return status;
+
+        status = read_reply(MSG_DONTWAIT);
+
+        if (status <= 0)
+            return status;
+    }
 }
 
-unsigned long flux_create_window() {
+int flux_dispatch() {
+    int status;
+
+    while ((status = read_reply(MSG_DONTWAIT)) > 0);
+
+    return status < 0;
+}
+
+int flux_sync() {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    strncpy(req.request, "SYNC", sizeof(req.request) - 1);
+
+    return flux_wait(send_request(&req, 0), NULL, 0);
+}
+
+int flux_enable_ring(unsigned int capacity) {
+    if (flux_ring)
+        return 0;
+
+    if (flux_sock_fd == -1) {
+        if (flux_init() != 0)
+            return 1;
+    }
+
+    if (capacity == 0)
+        capacity = FLUX_RING_DEFAULT_CAPACITY;
+
+    if (!flux_ring_valid_capacity(capacity)) {
+        printf("  EE: (flux_api.c) flux_enable_ring() -> capacity must be a power of two\n");
+
+        return 1;
+    }
+
+    size_t bytes = flux_ring_size(capacity);
+    int mem_fd = create_shared_memory("flux-ring", bytes);
+
+    if (mem_fd < 0) {
+        printf("  EE: (flux_api.c) flux_enable_ring() -> failed to create shared memory\n");
+
+        return 1;
+    }
+
+    flux_ring_t *ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+
+    if (ring == MAP_FAILED) {
+        printf("  EE: (flux_api.c) flux_enable_ring() -> failed to map the ring\n");
+
+        close(mem_fd);
+
+        return 1;
+    }
+
+    flux_ring_init(ring, capacity);
+
+    int event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (event_fd < 0) {
+        printf("  EE: (flux_api.c) flux_enable_ring() -> eventfd failed\n");
+
+        munmap(ring, bytes);
+        close(mem_fd);
+
+        return 1;
+    }
+
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    snprintf(req.request, sizeof(req.request), "ATTACH_RING:%u", capacity);
+
+    int fds[2] = { mem_fd, event_fd };
+    int status = flux_wait(send_request_fds(&req, 0, fds, 2), NULL, 0);
+
+    close(mem_fd);
+
+    if (status != 0) {
+        printf("  EE: (flux_api.c) flux_enable_ring() -> compositor rejected the ring\n");
+
+        munmap(ring, bytes);
+        close(event_fd);
+
+        return 1;
+    }
+
+    flux_ring = ring;
+    flux_ring_bytes = bytes;
+    flux_ring_event_fd = event_fd;
+
+    return 0;
+}
+
+flux_handle_t flux_create_window_async() {
     WindowRequest req;
-    unsigned long win_id = 0;
 
     memset(&req, 0, sizeof(req));
 
@@ -93,7 +461,13 @@ unsigned long flux_create_window() {
 
     strncpy(req.request, "CREATE_WINDOW", sizeof(req.request) - 1);
 
-    if (send_request(&req, &win_id, sizeof(win_id)) < 0) {
+    return send_request(&req, 0);
+}
+
+unsigned long flux_create_window() {
+    unsigned long win_id = 0;
+
+    if (flux_wait(flux_create_window_async(), &win_id, sizeof(win_id)) != 0) {
         printf("  EE: (flux_api.c) flux_create_window() -> failed to create window\n");
 
         return 0;
@@ -104,7 +478,6 @@ unsigned long flux_create_window() {
 
 int flux_show_window(unsigned long win_id) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -112,7 +485,7 @@ int flux_show_window(unsigned long win_id) {
 
     strncpy(req.request, "SHOW", sizeof(req.request) - 1);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_show_window() -> failed to show window %lu\n", win_id);
 
         return 1;
@@ -123,7 +496,6 @@ int flux_show_window(unsigned long win_id) {
 
 int flux_hide_window(unsigned long win_id) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -131,7 +503,7 @@ int flux_hide_window(unsigned long win_id) {
 
     strncpy(req.request, "HIDE", sizeof(req.request) - 1);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_hide_window() -> failed to hide window %lu\n", win_id);
 
         return 1;
@@ -142,7 +514,6 @@ int flux_hide_window(unsigned long win_id) {
 
 int flux_render_window(unsigned long win_id) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -150,7 +521,7 @@ int flux_render_window(unsigned long win_id) {
 
     strncpy(req.request, "RENDER", sizeof(req.request) - 1);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_render_window() -> failed to render window %lu\n", win_id);
 
         return 1;
@@ -159,9 +530,44 @@ int flux_render_window(unsigned long win_id) {
     return 0;
 }
 
+int flux_set_window_geometry(unsigned long win_id, int x, int y, int width, int height) {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "SET_WINDOW_GEOMETRY:%d:%d:%d:%d", x, y, width, height);
+
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
+        printf("  EE: (flux_api.c) flux_set_window_geometry() -> failed to set geometry for window %lu\n", win_id);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+int flux_set_window_opacity(unsigned long win_id, float opacity) {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "SET_WINDOW_OPACITY:%.3f", opacity);
+
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
+        printf("  EE: (flux_api.c) flux_set_window_opacity() -> failed to set opacity for window %lu\n", win_id);
+
+        return 1;
+    }
+
+    return 0;
+}
+
 int flux_add_widget(unsigned long win_id, const char *widget_id, widget_type_t type) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -169,7 +575,7 @@ int flux_add_widget(unsigned long win_id, const char *widget_id, widget_type_t t
 
     snprintf(req.request, sizeof(req.request), "CREATE_WIDGET:%s:%u", widget_id, type);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_add_widget() -> failed to add widget %s\n", widget_id);
 
         return 1;
@@ -178,9 +584,36 @@ int flux_add_widget(unsigned long win_id, const char *widget_id, widget_type_t t
     return 0;
 }
 
+flux_handle_t flux_create_widget_async(unsigned long win_id, const char *widget_id, widget_type_t type) {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "CREATE_WIDGET:%s:%u", widget_id, type);
+
+    return send_request(&req, 0);
+}
+
+flux_widget_t flux_create_widget(unsigned long win_id, const char *widget_id, widget_type_t type) {
+    flux_widget_t widget = 0;
+
+    if (flux_wait(flux_create_widget_async(win_id, widget_id, type), &widget, sizeof(widget)) != 0) {
+        printf("  EE: (flux_api.c) flux_create_widget() -> failed to create widget %s\n", widget_id);
+
+        return 0;
+    }
+
+    return widget;
+}
+
+void flux_widget_ref(flux_widget_t widget, char ref[FLUX_WIDGET_REF_SIZE]) {
+    snprintf(ref, FLUX_WIDGET_REF_SIZE, "#%u", widget);
+}
+
 int flux_set_widget_geometry(unsigned long win_id, const char *widget_id, float x, float y, float w, float h, int radius, int border_width) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -188,7 +621,7 @@ int flux_set_widget_geometry(unsigned long win_id, const char *widget_id, float
 
     snprintf(req.request, sizeof(req.request), "SET_WIDGET_GEOMETRY:%s:%f:%f:%f:%f:%d:%d", widget_id, x, y, w, h, radius, border_width);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_set_widget_geometry() -> failed to set geometry for widget %s\n", widget_id);
 
         return 1;
@@ -197,18 +630,35 @@ int flux_set_widget_geometry(unsigned long win_id, const char *widget_id, float
     return 0;
 }
 
+// hex colors are validated and packed here so the compositor only ever sees the binary form
 int flux_set_widget_color(unsigned long win_id, const char *widget_id, const char color[32]) {
+    size_t digits = color[0] == '#' ? strspn(color + 1, "0123456789abcdefABCDEF") : 0;
+
+    if ((digits != 6 && digits != 8) || color[1 + digits] != '\0') {
+        printf("  EE: (flux_api.c) flux_set_widget_color() -> invalid color %s for widget %s\n", color, widget_id);
+
+        return 1;
+    }
+
+    uint32_t rgba = (uint32_t)strtoul(color + 1, NULL, 16);
+
+    if (digits == 6)
+        rgba = (rgba << 8) | 0xff;
+
+    return flux_set_widget_rgba(win_id, widget_id, rgba);
+}
+
+int flux_set_widget_rgba(unsigned long win_id, const char *widget_id, uint32_t rgba) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
     req.id = win_id;
 
-    snprintf(req.request, sizeof(req.request), "SET_WIDGET_COLOR:%s:%s", widget_id, color);
+    snprintf(req.request, sizeof(req.request), "SET_WIDGET_RGBA:%s:%08x", widget_id, rgba);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
-        printf("  EE: (flux_api.c) flux_set_widget_color() -> failed to set color for widget %s\n", widget_id);
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
+        printf("  EE: (flux_api.c) flux_set_widget_rgba() -> failed to set color for widget %s\n", widget_id);
 
         return 1;
     }
@@ -218,7 +668,6 @@ int flux_set_widget_color(unsigned long win_id, const char *widget_id, const cha
 
 int flux_set_widget_text(unsigned long win_id, const char *widget_id, const char *text) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -226,7 +675,7 @@ int flux_set_widget_text(unsigned long win_id, const char *widget_id, const char
 
     snprintf(req.request, sizeof(req.request), "SET_WIDGET_TEXT:%s:%s", widget_id, text);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_set_widget_text() -> failed to set text for widget %s\n", widget_id);
 
         return 1;
@@ -237,7 +686,6 @@ int flux_set_widget_text(unsigned long win_id, const char *widget_id, const char
 
 int flux_set_widget_image(unsigned long win_id, const char *widget_id, const char *filename) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -245,7 +693,7 @@ int flux_set_widget_image(unsigned long win_id, const char *widget_id, const cha
 
     snprintf(req.request, sizeof(req.request), "SET_WIDGET_IMAGE:%s:%s", widget_id, filename);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_set_widget_image() -> failed to set image for widget %s\n", widget_id);
 
         return 1;
@@ -256,7 +704,6 @@ int flux_set_widget_image(unsigned long win_id, const char *widget_id, const cha
 
 int flux_set_widget_font(unsigned long win_id, const char *widget_id, const char *filename, int font_size) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -264,7 +711,7 @@ int flux_set_widget_font(unsigned long win_id, const char *widget_id, const char
 
     snprintf(req.request, sizeof(req.request), "SET_WIDGET_FONT:%s:%s:%d", widget_id, filename, font_size);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_set_widget_font() -> failed to set font for widget %s\n", widget_id);
 
         return 1;
@@ -275,7 +722,6 @@ int flux_set_widget_font(unsigned long win_id, const char *widget_id, const char
 
 int flux_remove_widget(unsigned long win_id, const char *widget_id) {
     WindowRequest req;
-    char response[32];
 
     memset(&req, 0, sizeof(req));
 
@@ -283,7 +729,7 @@ int flux_remove_widget(unsigned long win_id, const char *widget_id) {
 
     snprintf(req.request, sizeof(req.request), "REMOVE_WIDGET:%s", widget_id);
 
-    if (send_request(&req, response, sizeof(response)) < 0) {
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
         printf("  EE: (flux_api.c) flux_remoe_widget() -> failed to remove widget %s from window %lu\n", widget_id, win_id);
 
         return 1;
@@ -292,20 +738,25 @@ int flux_remove_widget(unsigned long win_id, const char *widget_id) {
     return 0;
 }
 
-int flux_get_screen_size(unsigned long win_id, int *width, int *height) {
+flux_handle_t flux_get_screen_size_async(unsigned long win_id) {
     WindowRequest req;
-    struct {
-        int w;
-        int h;
-    } response;
 
     memset(&req, 0, sizeof(req));
 
     req.id = win_id;
 
     snprintf(req.request, sizeof(req.request), "GET_SCREEN_SIZE");
-    
-    if (send_request(&req, &response, sizeof(response)) < 0) {
+
+    return send_request(&req, 0);
+}
+
+int flux_get_screen_size(unsigned long win_id, int *width, int *height) {
+    struct {
+        int w;
+        int h;
+    } response;
+
+    if (flux_wait(flux_get_screen_size_async(win_id), &response, sizeof(response)) != 0) {
         printf("  EE: (flux_api.c) flux_get_screen_size() -> failed to get screen size\n");
 
         *width = -1;
@@ -318,4 +769,144 @@ int flux_get_screen_size(unsigned long win_id, int *width, int *height) {
     *height = response.h;
 
     return 0;
-}
\ No newline at end of file
+}
+
+void *flux_attach_buffer(unsigned long win_id, const char *widget_id, int width, int height) {
+    if (width <= 0 || height <= 0) {
+        printf("  EE: (flux_api.c) flux_attach_buffer() -> invalid buffer size %dx%d\n", width, height);
+
+        return NULL;
+    }
+
+    size_t bytes = (size_t)width * height * 4;
+    int mem_fd = create_shared_memory("flux-buffer", bytes);
+
+    if (mem_fd < 0) {
+        printf("  EE: (flux_api.c) flux_attach_buffer() -> failed to create shared memory\n");
+
+        return NULL;
+    }
+
+    void *pixels = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+
+    if (pixels == MAP_FAILED) {
+        printf("  EE: (flux_api.c) flux_attach_buffer() -> failed to map the buffer\n");
+
+        close(mem_fd);
+
+        return NULL;
+    }
+
+    ClientBuffer *buffer = malloc(sizeof(ClientBuffer));
+
+    if (!buffer) {
+        munmap(pixels, bytes);
+        close(mem_fd);
+
+        return NULL;
+    }
+
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "ATTACH_BUFFER:%s:%d:%d", widget_id, width, height);
+
+    int status = flux_wait(send_request_fds(&req, 0, &mem_fd, 1), NULL, 0);
+
+    close(mem_fd);
+
+    if (status != 0) {
+        printf("  EE: (flux_api.c) flux_attach_buffer() -> failed to attach buffer to widget %s\n", widget_id);
+
+        munmap(pixels, bytes);
+        free(buffer);
+
+        return NULL;
+    }
+
+    buffer->pixels = pixels;
+    buffer->bytes = bytes;
+    buffer->next = flux_buffers;
+    flux_buffers = buffer;
+
+    return pixels;
+}
+
+int flux_commit_buffer(unsigned long win_id, const char *widget_id, int x, int y, int w, int h) {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "COMMIT_BUFFER:%s:%d:%d:%d:%d", widget_id, x, y, w, h);
+
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
+        printf("  EE: (flux_api.c) flux_commit_buffer() -> failed to commit buffer for widget %s\n", widget_id);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+void flux_destroy_buffer(void *pixels) {
+    ClientBuffer **link = &flux_buffers;
+
+    while (*link) {
+        ClientBuffer *buffer = *link;
+
+        if (buffer->pixels == pixels) {
+            *link = buffer->next;
+
+            munmap(buffer->pixels, buffer->bytes);
+            free(buffer);
+
+            return;
+        }
+
+        link = &buffer->next;
+    }
+}
+
+int flux_attach_dmabuf(unsigned long win_id, const char *widget_id, const flux_dmabuf_t *dmabuf, int release_fd) {
+    WindowRequest req;
+    int slot = -1;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "ATTACH_DMABUF:%s:%d:%d:%u:%u:%u:%llx", widget_id, dmabuf->width, dmabuf->height, dmabuf->fourcc, dmabuf->stride, dmabuf->offset, (unsigned long long)dmabuf->modifier);
+
+    int fds[2] = { dmabuf->fd, release_fd };
+
+    if (flux_wait(send_request_fds(&req, 0, fds, release_fd >= 0 ? 2 : 1), &slot, sizeof(slot)) != 0) {
+        printf("  EE: (flux_api.c) flux_attach_dmabuf() -> failed to attach dmabuf to widget %s\n", widget_id);
+
+        return -1;
+    }
+
+    return slot;
+}
+
+int flux_present_dmabuf(unsigned long win_id, const char *widget_id, int slot) {
+    WindowRequest req;
+
+    memset(&req, 0, sizeof(req));
+
+    req.id = win_id;
+
+    snprintf(req.request, sizeof(req.request), "PRESENT_DMABUF:%s:%d", widget_id, slot);
+
+    if (send_request(&req, FLUX_REQUEST_NO_REPLY) == 0) {
+        printf("  EE: (flux_api.c) flux_present_dmabuf() -> failed to present dmabuf for widget %s\n", widget_id);
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -8,32 +8,88 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
 #include "flux_type.h"
 
 #define SOCKET_PATH "/tmp/flux_comp.sock"
 
 typedef struct Window window_t;
 
+typedef struct {
+    int fd;
+    int width, height;
+    uint32_t fourcc;
+    uint32_t stride;
+    uint32_t offset;
+    uint64_t modifier;
+} flux_dmabuf_t;
+
+#define FLUX_REQUEST_NO_REPLY 0x1
+
+#define FLUX_REPLY_RESULT 0
+#define FLUX_REPLY_ERROR_EVENT 1
+
 typedef struct {
     unsigned long id;
+    uint32_t seq;
+    uint32_t flags;
     char request[256];
 } WindowRequest;
 
+typedef struct {
+    uint32_t seq;
+    uint32_t type;
+    int32_t status;
+    uint32_t size;
+    unsigned char data[48];
+} WindowReply;
+
+#define FLUX_WIDGET_REF_SIZE 16
+
+#define FLUX_RGBA(r, g, b, a) (((uint32_t)(r) & 0xff) << 24 | ((uint32_t)(g) & 0xff) << 16 | ((uint32_t)(b) & 0xff) << 8 | ((uint32_t)(a) & 0xff))
+
+typedef uint32_t flux_handle_t;
+typedef uint32_t flux_widget_t;
+typedef void (*flux_error_fn)(uint32_t seq, int status, const char *message);
+
 int flux_init();
 void flux_shutdown(unsigned long win_id);
+int flux_enable_ring(unsigned int capacity);
+
+void flux_set_error_handler(flux_error_fn handler);
+uint32_t flux_last_seq();
+int flux_wait(flux_handle_t handle, void *result, size_t size);
+int flux_poll(flux_handle_t handle, void *result, size_t size);
+int flux_dispatch();
+int flux_sync();
+
+flux_handle_t flux_create_window_async();
+flux_handle_t flux_get_screen_size_async(unsigned long win_id);
 unsigned long flux_create_window();
 int flux_show_window(unsigned long win_id);
 int flux_hide_window(unsigned long win_id);
 int flux_render_window(unsigned long win_id);
+int flux_set_window_geometry(unsigned long win_id, int x, int y, int width, int height);
+int flux_set_window_opacity(unsigned long win_id, float opacity);
 
 int flux_add_widget(unsigned long win_id, const char *widget_id, widget_type_t type);
+flux_handle_t flux_create_widget_async(unsigned long win_id, const char *widget_id, widget_type_t type);
+flux_widget_t flux_create_widget(unsigned long win_id, const char *widget_id, widget_type_t type);
+void flux_widget_ref(flux_widget_t widget, char ref[FLUX_WIDGET_REF_SIZE]);
 int flux_set_widget_geometry(unsigned long win_id, const char *widget_id, float x, float y, float w, float h, int radius, int border_width);
 int flux_set_widget_color(unsigned long win_id, const char *widget_id, const char color[32]);
+int flux_set_widget_rgba(unsigned long win_id, const char *widget_id, uint32_t rgba);
 int flux_set_widget_text(unsigned long win_id, const char *widget_id, const char *text);
 int flux_set_widget_image(unsigned long win_id, const char *widget_id, const char *filename);
 int flux_set_widget_font(unsigned long win_id, const char *widget_id, const char *filename, int font_size);
 int flux_remove_widget(unsigned long win_id, const char *widget_id);
 
+void *flux_attach_buffer(unsigned long win_id, const char *widget_id, int width, int height);
+int flux_commit_buffer(unsigned long win_id, const char *widget_id, int x, int y, int w, int h);
+void flux_destroy_buffer(void *pixels);
+int flux_attach_dmabuf(unsigned long win_id, const char *widget_id, const flux_dmabuf_t *dmabuf, int release_fd);
+int flux_present_dmabuf(unsigned long win_id, const char *widget_id, int slot);
+
 int flux_get_screen_size(unsigned long win_id, int *width, int *height);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef FLUX_RING_H
+#define FLUX_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "flux_api.h"
+
+#define FLUX_RING_DEFAULT_CAPACITY 1024
+
+// single-producer (client) / single-consumer (compositor) ring of requests living in a shared memfd
+typedef struct {
+    _Atomic uint32_t head;
+    char head_pad[60];
+    _Atomic uint32_t tail;
+    char tail_pad[60];
+    uint32_t capacity;
+    uint32_t reserved[15];
+    WindowRequest slots[];
+} flux_ring_t;
+
+static inline size_t flux_ring_size(uint32_t capacity) {
+    return sizeof(flux_ring_t) + (size_t)capacity * sizeof(WindowRequest);
+}
+
+static inline bool flux_ring_valid_capacity(uint32_t capacity) {
+    return capacity > 0 && capacity <= (1u << 20) && (capacity & (capacity - 1)) == 0;
+}
+
+static inline void flux_ring_init(flux_ring_t *ring, uint32_t capacity) {
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+    ring->capacity = capacity;
+}
+
+// returns 0 on success and 1 when the ring is full, was_empty reports an empty -> non-empty transition
+static inline int flux_ring_push(flux_ring_t *ring, const WindowRequest *req, bool *was_empty) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->capacity)
+        return 1;
+
+    memcpy(&ring->slots[head & (ring->capacity - 1)], req, sizeof(*req));
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    if (was_empty) {
+        atomic_thread_fence(memory_order_seq_cst);
+
+        *was_empty = atomic_load_explicit(&ring->tail, memory_order_acquire) == head;
+    }
+
+    return 0;
+}
+
+// pairs with the fence in flux_ring_push so either the consumer sees new work or the producer signals it
+static inline bool flux_ring_empty(flux_ring_t *ring) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    return atomic_load_explicit(&ring->head, memory_order_acquire) == atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+// returns 1 when a request was popped, 0 when empty and -1 when the producer corrupted the indices
+static inline int flux_ring_pop(flux_ring_t *ring, uint32_t capacity, WindowRequest *out) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+        return 0;
+
+    if (head - tail > capacity)
+        return -1;
+
+    memcpy(out, &ring->slots[tail & (capacity - 1)], sizeof(*out));
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    out->request[sizeof(out->request) - 1] = '\0';
+
+    return 1;
+}
+
+#endif
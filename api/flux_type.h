@@ -5,7 +5,8 @@ typedef enum {
     WIDGET_NONE,
     WIDGET_RECT,
     WIDGET_TEXT,
-    WIDGET_IMAGE
+    WIDGET_IMAGE,
+    WIDGET_BUFFER
 } widget_type_t;
 
 #endif
\ No newline at end of file
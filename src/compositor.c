@@ -1,13 +1,25 @@
 #include "compositor.h"
 #include "GLES2/gl2.h"
 #include "lib/flux_ui.h"
+#include "lib/flux_pool.h"
+#include "lib/flux_raster.h"
 #include "sys_ui.h"
 #include "input.h"
+#include "ipc.h"
 #include "../api/flux_api.h"
 #include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 typedef struct Window window_t;
 
+#define COMP_MAX_LAYER_UNITS 8
+#define PROGRAM_CACHE_MAGIC 0x46505243
+#define PROGRAM_CACHE_MAX_SIZE (4 << 20)
+#define COMP_HEADLESS_WIDTH 1280
+#define COMP_HEADLESS_HEIGHT 720
+
 int drm_fd = -1;
 drmModeRes *resources = NULL;
 drmModeConnector *connector = NULL;
@@ -20,31 +32,15 @@ EGLDisplay egl_display = NULL;
 EGLConfig egl_config = NULL;
 EGLContext egl_context = NULL;
 EGLSurface egl_surface = NULL;
-
-GLuint program;
-GLint attr_pos;
-GLint uni_color;
-GLint uni_rect_pos;
-GLint uni_rect_size;
-GLint uni_screen_size;
-GLint uni_radius;
-GLint uni_use_texture;
-GLint uni_tex;
-
-GLuint text_program;
-GLint text_attr_pos;
-GLint text_attr_uv;
-GLint text_uni_glyph_pos;
-GLint text_uni_glyph_size;
-GLint text_uni_screen_size;
-GLint text_uni_color;
-GLint text_uni_tex;
+int gles_version = 2;
 
 GLuint comp_program;
 GLint comp_attr_pos;
-GLint comp_uni_tex;
+GLint comp_attr_uv;
+GLint comp_attr_layer;
+GLint comp_uni_tex[COMP_MAX_LAYER_UNITS];
+int comp_layer_units = 1;
 
-GLuint vbo;
 
 static struct gbm_bo *previous_bo = NULL;
 static uint32_t previous_fb = 0;
@@ -52,17 +48,42 @@ static drmModeCrtc *orig_crtc = NULL;
 static volatile sig_atomic_t running = 1;
 static int frame_pending = 0;
 static bool menu_open = false;
+static bool threaded_windows = false;
 
+// the CPU renderer scans out of two dumb buffers, or renders into plain memory when there is
+// no display to take over at all
+typedef struct {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint32_t pitch;
+    uint64_t size;
+    uint32_t *pixels;
+} DumbBuffer;
+
+static DumbBuffer dumb_buffers[2];
+static int dumb_back = 0;
+static bool dumb_scanout = false;
+static uint32_t *headless_pixels = NULL;
+static drmModeModeInfo headless_mode;
+
+// slots are linked bottom to top in stacking order, ids carry the slot generation
 typedef struct {
-    unsigned long id;
     window_t *window;
+    ClientEntry *owner;
+    unsigned long generation;
+    uint32_t next_free;
+    uint32_t below;
+    uint32_t above;
+    bool mapped;
 } WindowEntry;
 
-static int server_fd;
-static struct sockaddr_un addr;
-
-static WindowEntry window_registry[MAX_WINDOWS];
-static int registry_count = 0;
+static WindowEntry *window_registry = NULL;
+static uint32_t registry_capacity = 0;
+static uint32_t registry_used = 0;
+static uint32_t registry_count = 0;
+static uint32_t registry_free = 0;
+static uint32_t stack_bottom = 0;
+static uint32_t stack_top = 0;
 
 static window_t *requested_window;
 static window_t *focused_window;
@@ -70,127 +91,199 @@ static window_t *sys_ui_win;
 static window_t *sys_ui_menu_win;
 static window_t *mouse_win;
 
+typedef ui_layer_t CompLayer;
+
+static CompLayer *compose_layers = NULL;
+static int layer_count = 0;
+static int layer_capacity = 0;
+
 static widget_t *mouse_cursor;
 
-static int active_clients[MAX_CLIENTS];
-static int client_count = 0;
+typedef enum {
+    EVENT_SOURCE_DRM,
+    EVENT_SOURCE_INPUT,
+    EVENT_SOURCE_IPC
+} event_source_type_t;
 
-static const float comp_quad[] = {
-    -1.0f, -1.0f,
-    1.0f, -1.0f,
-    -1.0f,  1.0f,
-    1.0f,  1.0f,
-};
+static int epoll_fd = -1;
+static event_source_type_t drm_source = EVENT_SOURCE_DRM;
+static event_source_type_t input_source = EVENT_SOURCE_INPUT;
+static event_source_type_t ipc_source = EVENT_SOURCE_IPC;
 
+// widget quads are drawn by variants of one program chosen per batch; quads arrive cut to their
+// clip rect, so no variant discards and only rounded ones pay for the corner distance field
 static const char *vertex_shader_src =
     "attribute vec2 pos;\n"
+    "attribute vec2 uv;\n"
+    "attribute vec4 color;\n"
+    "attribute vec2 params;\n"
+
+    "uniform vec2 screen_size;\n"
 
-    "uniform mediump vec2 rect_pos;\n"
-    "uniform mediump vec2 rect_size;\n"
-    "uniform mediump vec2 screen_size;\n"
     "varying vec2 v_uv;\n"
+    "varying vec4 v_color;\n"
+
+    "#ifdef ROUNDED\n"
+    "attribute vec2 local;\n"
+    "attribute vec2 size;\n"
+
+    "varying vec2 v_local;\n"
+    "varying vec2 v_size;\n"
+    "varying float v_radius;\n"
+    "#endif\n"
 
     "void main() {\n"
-    "   vec2 pixel = rect_pos + pos * rect_size;\n"
-    "   pixel.y = screen_size.y - pixel.y;\n"
+    "   vec2 pixel = vec2(pos.x, screen_size.y - pos.y);\n"
     "   vec2 ndc = (pixel / screen_size) * 2.0 - 1.0;\n"
-    "   gl_Position = vec4(ndc, 0.0, 1.0);\n"
-    "   v_uv = pos;\n"
+    "   gl_Position = vec4(ndc, params.y, 1.0);\n"
+    "   v_uv = uv;\n"
+    "   v_color = color;\n"
+
+    "#ifdef ROUNDED\n"
+    "   v_local = local;\n"
+    "   v_size = size;\n"
+    "   v_radius = params.x;\n"
+    "#endif\n"
     "}\n";
 
 static const char *fragment_shader_src =
-    "#extension GL_OES_standard_derivatives : enable\n"
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
     "precision mediump float;\n"
+    "#endif\n"
 
-    "uniform bool use_texture;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_color;\n"
 
+    "#if defined(TEXTURE) || defined(GLYPH)\n"
     "uniform sampler2D tex;\n"
-    "uniform vec4 color;\n"
-    "uniform float radius;\n"
-    "uniform vec2 rect_size;\n"
+    "#endif\n"
 
-    "varying vec2 v_uv;\n"
+    "#ifdef ROUNDED\n"
+    "varying vec2 v_local;\n"
+    "varying vec2 v_size;\n"
+    "varying float v_radius;\n"
 
     "float sdRoundRect(vec2 p, vec2 size, float r) {\n"
     "	vec2 q = abs(p - size * 0.5) - (size * 0.5 - vec2(r));\n"
     "	return length(max(q, 0.0)) - r;\n"
     "}\n"
+    "#endif\n"
 
     "void main() {\n"
-    "	vec2 p = v_uv * rect_size;\n"
-    "	float dist = sdRoundRect(p, rect_size, radius);\n"
-
-    "   float aa = fwidth(dist);\n"
-    "   float alpha;\n"
+    "	vec4 out_color = v_color;\n"
 
-    "   alpha = 1.0 - smoothstep(0.0, aa, dist);\n"
+    "#ifdef TEXTURE\n"
+    "   vec4 tex_color = texture2D(tex, v_uv);\n"
+    "   out_color = vec4(tex_color.rgb, out_color.a * tex_color.a);\n"
+    "#endif\n"
 
-    "	vec4 out_color = color;\n"
-    "	out_color.a *= alpha;\n"
+    "#ifdef GLYPH\n"
+    "   out_color.a *= texture2D(tex, v_uv).a;\n"
+    "#endif\n"
 
-    "	if (use_texture) {\n"
-    "		vec4 tex_color = texture2D(tex, v_uv);\n"
-    "       out_color = vec4(tex_color.rgb, out_color.a * tex_color.a);\n"
-    "	}\n"
+    // local coordinates are window pixels, so one pixel of smoothing replaces fwidth()
+    "#ifdef ROUNDED\n"
+    "   out_color.a *= 1.0 - smoothstep(0.0, 1.0, sdRoundRect(v_local, v_size, v_radius));\n"
+    "#endif\n"
 
     "	gl_FragColor = out_color;\n"
     "}\n";
 
-static const char *text_vertex_shader_src =
-    "attribute vec2 pos;\n"
-    "attribute vec2 uv;\n"
-    
-    "uniform mediump vec2 glyph_pos;\n"
-    "uniform mediump vec2 glyph_size;\n"
-    "uniform mediump vec2 screen_size;\n"
+// GLES3 versions of the widget program, one instance per quad expanded from a shared corner strip
+static const char *vertex_shader_es3_src =
+    "layout(location = 0) in vec2 corner;\n"
+    "layout(location = 1) in vec4 rect;\n"
+    "layout(location = 2) in vec4 uv_rect;\n"
+    "layout(location = 3) in vec4 frame;\n"
+    "layout(location = 4) in vec2 params;\n"
+    "layout(location = 5) in vec4 color;\n"
 
-    "varying mediump vec2 v_uv;\n"
+    "layout(std140) uniform Frame {\n"
+    "   vec2 screen_size;\n"
+    "};\n"
 
-    "void main() {\n"
-    "   vec2 pixel = glyph_pos + pos * glyph_size;\n"
-    "   pixel.y = screen_size.y - pixel.y;\n"
+    "out vec2 v_uv;\n"
+    "out vec4 v_color;\n"
 
-    "   vec2 ndc = (pixel / screen_size) * 2.0 - 1.0;\n"
-    "   gl_Position = vec4(ndc, 0.0, 1.0);\n"
+    "#ifdef ROUNDED\n"
+    "out vec2 v_local;\n"
+    "out vec2 v_size;\n"
+    "out float v_radius;\n"
+    "#endif\n"
 
-    "   v_uv = uv;\n"
+    "void main() {\n"
+    "   vec2 pos = mix(rect.xy, rect.zw, corner);\n"
+    "   vec2 pixel = vec2(pos.x, screen_size.y - pos.y);\n"
+    "   vec2 ndc = (pixel / screen_size) * 2.0 - 1.0;\n"
+    "   gl_Position = vec4(ndc, params.y, 1.0);\n"
+    "   v_uv = mix(uv_rect.xy, uv_rect.zw, corner);\n"
+    "   v_color = color;\n"
+
+    "#ifdef ROUNDED\n"
+    "   v_local = pos - frame.xy;\n"
+    "   v_size = frame.zw;\n"
+    "   v_radius = params.x;\n"
+    "#endif\n"
     "}\n";
 
-static const char *text_fragment_shader_src =
-    "precision mediump float;\n"
+static const char *fragment_shader_es3_src =
+    "precision highp float;\n"
+
+    "in vec2 v_uv;\n"
+    "in vec4 v_color;\n"
 
+    "out vec4 frag_color;\n"
+
+    "#if defined(TEXTURE) || defined(GLYPH)\n"
     "uniform sampler2D tex;\n"
-    "uniform vec4 color;\n"
+    "#endif\n"
+
+    "#ifdef ROUNDED\n"
+    "in vec2 v_local;\n"
+    "in vec2 v_size;\n"
+    "in float v_radius;\n"
 
-    "varying mediump vec2 v_uv;\n"
+    "float sdRoundRect(vec2 p, vec2 size, float r) {\n"
+    "	vec2 q = abs(p - size * 0.5) - (size * 0.5 - vec2(r));\n"
+    "	return length(max(q, 0.0)) - r;\n"
+    "}\n"
+    "#endif\n"
 
     "void main() {\n"
-    "   float a = texture2D(tex, v_uv).a;\n"
+    "	vec4 out_color = v_color;\n"
 
-    "   if (a <= 0.01) {\n"
-    "       discard;\n"
-    "   }\n"
-    
-    "   gl_FragColor = vec4(color.rgb, color.a * a);\n"
-    "}\n";
+    "#ifdef TEXTURE\n"
+    "   vec4 tex_color = texture(tex, v_uv);\n"
+    "   out_color = vec4(tex_color.rgb, out_color.a * tex_color.a);\n"
+    "#endif\n"
 
-static const char *comp_vertex_shader_src =
-    "attribute vec2 a_pos;\n"
-    "varying vec2 v_uv;\n"
+    "#ifdef GLYPH\n"
+    "   out_color.a *= texture(tex, v_uv).a;\n"
+    "#endif\n"
 
-    "void main() {\n"
-    "    v_uv = a_pos * 0.5 + 0.5;\n"
-    "    gl_Position = vec4(a_pos, 0.0, 1.0);\n"
+    "#ifdef ROUNDED\n"
+    "   out_color.a *= 1.0 - smoothstep(0.0, 1.0, sdRoundRect(v_local, v_size, v_radius));\n"
+    "#endif\n"
+
+    "	frag_color = out_color;\n"
     "}\n";
 
-static const char *comp_fragment_shader_src =
-    "precision mediump float;\n"
+// window layers are drawn as one quad each; a layer picks its texture unit with x and scales
+// its alpha by y, so up to comp_layer_units windows share a draw call
+static const char *comp_vertex_shader_src =
+    "attribute vec2 a_pos;\n"
+    "attribute vec2 a_uv;\n"
+    "attribute vec2 a_layer;\n"
 
-    "uniform sampler2D u_tex;\n"
     "varying vec2 v_uv;\n"
+    "varying vec2 v_layer;\n"
 
     "void main() {\n"
-    "    gl_FragColor = texture2D(u_tex, v_uv);\n"
+    "    v_uv = a_uv;\n"
+    "    v_layer = a_layer;\n"
+    "    gl_Position = vec4(a_pos, 0.0, 1.0);\n"
     "}\n";
 
 static void handle_signal(int sig) {
@@ -269,71 +362,223 @@ static GLuint compile_shader(GLenum type, const char *src) {
     return shader;
 }
 
-static GLuint create_program() {
-    GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_shader_src);
-    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_src);
+// linked programs are kept on disk per source hash, the header carries a hash of the driver
+// strings so an updated driver simply misses and overwrites its entries
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t driver_hash;
+    uint64_t source_hash;
+    uint32_t length;
+    uint32_t reserved;
+} ProgramCacheHeader;
+
+static struct {
+    PFNGLGETPROGRAMBINARYOESPROC get_binary;
+    PFNGLPROGRAMBINARYOESPROC load_binary;
+    uint64_t driver_hash;
+    char dir[256];
+    bool enabled;
+} program_cache;
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
 
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
+    return hash;
+}
 
-    GLint ok;
+static uint64_t hash_string(uint64_t hash, const char *str) {
+    return hash_bytes(hash, str ? str : "", str ? strlen(str) + 1 : 1);
+}
 
-    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+static int make_cache_dir(const char *path) {
+    char dir[256];
 
-    if (!ok) {
-        char log[512];
+    snprintf(dir, sizeof(dir), "%s", path);
 
-        glGetProgramInfoLog(prog, sizeof(log), NULL, log);
+    for (char *c = dir + 1; *c; c++) {
+        if (*c != '/')
+            continue;
 
-        printf("  EE: (compositor.c) create_program() -> %s\n", log);
+        *c = '\0';
 
-        glDeleteProgram(prog);
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+            return 1;
 
-        return 0;
+        *c = '/';
     }
 
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+        return 1;
 
-    return prog;
+    return 0;
 }
 
-static GLuint create_text_program() {
-    GLuint vs = compile_shader(GL_VERTEX_SHADER, text_vertex_shader_src);
-    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, text_fragment_shader_src);
-    
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
+static void program_cache_init() {
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    GLint formats = 0;
 
-    GLint ok;
+    if (!extensions || !strstr(extensions, "GL_OES_get_program_binary"))
+        return;
 
-    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
 
-    if (!ok) {
-        char log[512];
+    if (formats <= 0)
+        return;
 
-        glGetProgramInfoLog(prog, sizeof(log), NULL, log);
+    program_cache.get_binary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+    program_cache.load_binary = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
 
-        printf("  EE: (compositor.c) create_text_program() -> %s\n", log);
+    if (!program_cache.get_binary || !program_cache.load_binary)
+        return;
 
-        glDeleteProgram(prog);
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (cache_home && *cache_home)
+        snprintf(program_cache.dir, sizeof(program_cache.dir), "%s/flux/shaders", cache_home);
+    else if (home && *home)
+        snprintf(program_cache.dir, sizeof(program_cache.dir), "%s/.cache/flux/shaders", home);
+    else
+        return;
+
+    if (make_cache_dir(program_cache.dir) != 0) {
+        printf("  WW: (compositor.c) program_cache_init() -> cannot create %s, shader cache disabled\n", program_cache.dir);
+
+        return;
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    hash = hash_string(hash, (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+    program_cache.driver_hash = hash;
+    program_cache.enabled = true;
+}
+
+static void program_cache_path(uint64_t source_hash, char *path, size_t size) {
+    snprintf(path, size, "%s/%016llx.bin", program_cache.dir, (unsigned long long)source_hash);
+}
+
+static GLuint program_cache_load(uint64_t source_hash) {
+    char path[320];
+    ProgramCacheHeader header;
+
+    program_cache_path(source_hash, path, sizeof(path));
+
+    FILE *file = fopen(path, "rb");
+
+    if (!file)
+        return 0;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != PROGRAM_CACHE_MAGIC || header.driver_hash != program_cache.driver_hash || header.source_hash != source_hash || header.length == 0 || header.length > PROGRAM_CACHE_MAX_SIZE) {
+        fclose(file);
 
         return 0;
     }
 
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    void *binary = malloc(header.length);
+
+    if (!binary || fread(binary, 1, header.length, file) != header.length) {
+        free(binary);
+        fclose(file);
+
+        return 0;
+    }
+
+    fclose(file);
+
+    GLuint prog = glCreateProgram();
+    GLint ok = 0;
+
+    program_cache.load_binary(prog, header.format, binary, header.length);
+
+    free(binary);
+
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+
+    // a rejected binary is expected after some driver changes, the caller just relinks
+    if (!ok) {
+        glDeleteProgram(prog);
+
+        return 0;
+    }
 
     return prog;
 }
 
-static GLuint create_comp_program() {
-    GLuint vs = compile_shader(GL_VERTEX_SHADER, comp_vertex_shader_src);
-    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, comp_fragment_shader_src);
+static void program_cache_store(GLuint prog, uint64_t source_hash) {
+    GLint length = 0;
+
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+
+    if (length <= 0 || length > PROGRAM_CACHE_MAX_SIZE)
+        return;
+
+    void *binary = malloc(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+
+    if (!binary)
+        return;
+
+    program_cache.get_binary(prog, length, &written, &format, binary);
+
+    ProgramCacheHeader header = {
+        .magic = PROGRAM_CACHE_MAGIC,
+        .format = format,
+        .driver_hash = program_cache.driver_hash,
+        .source_hash = source_hash,
+        .length = written,
+    };
+
+    char path[320];
+    char tmp_path[336];
+
+    program_cache_path(source_hash, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+    // written aside and renamed so a crash or a second instance never leaves a torn entry
+    FILE *file = fopen(tmp_path, "wb");
+
+    if (file) {
+        bool ok = written > 0 && fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary, 1, written, file) == (size_t)written;
+
+        if (fclose(file) == 0 && ok)
+            ok = rename(tmp_path, path) == 0;
+
+        if (!ok) {
+            unlink(tmp_path);
+
+            printf("  WW: (compositor.c) program_cache_store() -> failed to write %s\n", path);
+        }
+    }
+
+    free(binary);
+}
+
+static GLuint create_program(const char *vertex_src, const char *fragment_src) {
+    uint64_t source_hash = 0;
+
+    if (program_cache.enabled) {
+        source_hash = hash_string(hash_string(14695981039346656037ull, vertex_src), fragment_src);
+
+        GLuint cached = program_cache_load(source_hash);
+
+        if (cached)
+            return cached;
+    }
+
+    GLuint vs = compile_shader(GL_VERTEX_SHADER, vertex_src);
+    GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fragment_src);
 
     GLuint prog = glCreateProgram();
     glAttachShader(prog, vs);
@@ -349,7 +594,7 @@ static GLuint create_comp_program() {
 
         glGetProgramInfoLog(prog, sizeof(log), NULL, log);
 
-        printf("  EE: (compositor.c) create_comp_program() -> %s\n", log);
+        printf("  EE: (compositor.c) create_program() -> %s\n", log);
 
         glDeleteProgram(prog);
 
@@ -359,39 +604,175 @@ static GLuint create_comp_program() {
     glDeleteShader(vs);
     glDeleteShader(fs);
 
+    if (program_cache.enabled)
+        program_cache_store(prog, source_hash);
+
     return prog;
 }
 
-void cleanup() {
-    printf("  II: (compositor.c) cleanup() -> cleaning up...\n");
+static char *shader_variant_source(int variant, const char *src) {
+    size_t size = strlen(src) + 128;
+    char *out = malloc(size);
 
-    if (previous_bo) {
-        if (previous_fb)
-            drmModeRmFB(drm_fd, previous_fb);
+    if (!out)
+        return NULL;
 
-        gbm_surface_release_buffer(gbm_surface, previous_bo);
+    snprintf(out, size, "%s%s%s%s%s",
+        gles_version >= 3 ? "#version 300 es\n" : "",
+        variant & UI_SHADER_TEXTURE ? "#define TEXTURE\n" : "",
+        variant & UI_SHADER_GLYPH ? "#define GLYPH\n" : "",
+        variant & UI_SHADER_ROUNDED ? "#define ROUNDED\n" : "",
+        src);
 
-        previous_bo = NULL;
-        previous_fb = 0;
+    return out;
+}
+
+// glyph quads are never textured images, every other combination is compiled once up front
+static int create_ui_shaders() {
+    for (int variant = 0; variant < UI_SHADER_VARIANTS; variant++) {
+        ui_shader_t *shader = &ui_shaders[variant];
+
+        if ((variant & UI_SHADER_TEXTURE) && (variant & UI_SHADER_GLYPH))
+            continue;
+
+        char *vertex_src = shader_variant_source(variant, gles_version >= 3 ? vertex_shader_es3_src : vertex_shader_src);
+        char *fragment_src = shader_variant_source(variant, gles_version >= 3 ? fragment_shader_es3_src : fragment_shader_src);
+
+        shader->program = vertex_src && fragment_src ? create_program(vertex_src, fragment_src) : 0;
+
+        free(vertex_src);
+        free(fragment_src);
+
+        if (!shader->program) {
+            printf("  EE: (compositor.c) create_ui_shaders() -> failed to build shader variant 0x%x\n", variant);
+
+            return 1;
+        }
+
+        shader->attr_pos = glGetAttribLocation(shader->program, "pos");
+        shader->attr_local = glGetAttribLocation(shader->program, "local");
+        shader->attr_size = glGetAttribLocation(shader->program, "size");
+        shader->attr_uv = glGetAttribLocation(shader->program, "uv");
+        shader->attr_color = glGetAttribLocation(shader->program, "color");
+        shader->attr_params = glGetAttribLocation(shader->program, "params");
+        shader->uni_screen_size = glGetUniformLocation(shader->program, "screen_size");
+        shader->uni_tex = glGetUniformLocation(shader->program, "tex");
+
+        // block binding and sampler unit are program state, set once instead of on every draw
+        if (gles_version >= 3) {
+            GLuint frame_block = glGetUniformBlockIndex(shader->program, "Frame");
+
+            if (frame_block != GL_INVALID_INDEX)
+                glUniformBlockBinding(shader->program, frame_block, UI_FRAME_BINDING);
+
+            glUseProgram(shader->program);
+            glUniform1i(shader->uni_tex, 0);
+        }
     }
 
-    if (orig_crtc) {
-        drmModeSetCrtc(
-            drm_fd,
-            orig_crtc->crtc_id,
-            orig_crtc->buffer_id,
-            orig_crtc->x,
-            orig_crtc->y,
-            &connector->connector_id,
-            1,
-            &orig_crtc->mode
-        );
+    return 0;
+}
 
-        drmModeFreeCrtc(orig_crtc);
+// ES 2.0 cannot index a sampler array with a varying, so the unit is chosen by an unrolled chain
+static char *build_comp_fragment_shader(int units) {
+    size_t size = 512 + (size_t)units * 128;
+    char *src = malloc(size);
 
-        orig_crtc = NULL;
+    if (!src)
+        return NULL;
+
+    int len = snprintf(src, size, "precision mediump float;\n");
+
+    for (int i = 0; i < units; i++)
+        len += snprintf(src + len, size - len, "uniform sampler2D u_tex%d;\n", i);
+
+    len += snprintf(src + len, size - len,
+        "varying vec2 v_uv;\n"
+        "varying vec2 v_layer;\n"
+
+        "void main() {\n"
+        "    vec4 color;\n");
+
+    for (int i = 0; i < units; i++) {
+        if (i == units - 1)
+            len += snprintf(src + len, size - len, "    %scolor = texture2D(u_tex%d, v_uv);\n", i ? "else " : "", i);
+        else
+            len += snprintf(src + len, size - len, "    %sif (v_layer.x < %d.5) color = texture2D(u_tex%d, v_uv);\n", i ? "else " : "", i, i);
+    }
+
+    snprintf(src + len, size - len,
+        "    gl_FragColor = vec4(color.rgb, color.a * v_layer.y);\n"
+        "}\n");
+
+    return src;
+}
+
+static GLuint create_comp_program() {
+    GLint max_units = 0;
+
+    glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_units);
+
+    comp_layer_units = max_units < COMP_MAX_LAYER_UNITS ? max_units : COMP_MAX_LAYER_UNITS;
+
+    if (comp_layer_units < 1)
+        comp_layer_units = 1;
+
+    char *fragment_src = build_comp_fragment_shader(comp_layer_units);
+
+    if (!fragment_src) {
+        printf("  EE: (compositor.c) create_comp_program() -> malloc failed for shader source\n");
+
+        return 0;
     }
 
+    GLuint prog = create_program(comp_vertex_shader_src, fragment_src);
+
+    free(fragment_src);
+
+    return prog;
+}
+
+static int init_gles();
+static int init_raster();
+static void comp_gl_begin_frame();
+static void comp_gl_compose(const CompLayer *layers, int count, bool screen_covered);
+static void comp_raster_begin_frame();
+static int comp_raster_present();
+int render_frame();
+
+// every pixel the compositor and the widget library touch goes through one of these
+static ui_backend_t gles_backend = {
+    .name = "gles",
+    .create_texture = ui_gl_create_texture,
+    .update_texture = ui_gl_update_texture,
+    .destroy_texture = ui_gl_destroy_texture,
+    .create_target = ui_gl_create_target,
+    .resize_target = ui_gl_resize_target,
+    .destroy_target = ui_gl_destroy_target,
+    .attach_depth = ui_gl_attach_depth,
+    .draw_window = ui_gl_draw_window,
+    .begin_frame = comp_gl_begin_frame,
+    .compose = comp_gl_compose,
+    .present = render_frame,
+};
+
+static const ui_backend_t raster_backend = {
+    .name = "raster",
+    .instanced = true,
+    .max_texture_size = UI_RASTER_MAX_TEXTURE_SIZE,
+    .create_texture = ui_raster_create_texture,
+    .update_texture = ui_raster_update_texture,
+    .destroy_texture = ui_raster_destroy_texture,
+    .create_target = ui_raster_create_target,
+    .resize_target = ui_raster_resize_target,
+    .destroy_target = ui_raster_destroy_target,
+    .draw_window = ui_raster_draw_window,
+    .begin_frame = comp_raster_begin_frame,
+    .compose = ui_raster_compose,
+    .present = comp_raster_present,
+};
+
+static void release_gles() {
     if (egl_display != EGL_NO_DISPLAY) {
         eglMakeCurrent(egl_display,
                        EGL_NO_SURFACE,
@@ -426,63 +807,140 @@ void cleanup() {
 
         gbm = NULL;
     }
+}
 
-    if (connector) {
-        drmModeFreeConnector(connector);
+static void destroy_dumb_buffer(DumbBuffer *buffer) {
+    if (buffer->pixels)
+        munmap(buffer->pixels, buffer->size);
 
-        connector = NULL;
-    }
+    if (buffer->fb_id)
+        drmModeRmFB(drm_fd, buffer->fb_id);
 
-    if (encoder) {
-        drmModeFreeEncoder(encoder);
+    if (buffer->handle) {
+        struct drm_mode_destroy_dumb destroy = { .handle = buffer->handle };
 
-        encoder = NULL;
+        drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
     }
 
-    if (resources) {
-        drmModeFreeResources(resources);
-
-        resources = NULL;
-    }
+    memset(buffer, 0, sizeof(*buffer));
+}
 
-    if (drm_fd >= 0)
-        drmDropMaster(drm_fd);
+static void release_raster() {
+    if (ui_backend != &raster_backend)
+        return;
 
-    if (drm_fd >= 0) {
-        close(drm_fd);
+    for (int i = 0; i < 2; i++)
+        destroy_dumb_buffer(&dumb_buffers[i]);
 
-        drm_fd = -1;
-    }
+    free(headless_pixels);
 
-    if (server_fd >= 0) {
-        close(server_fd);
-        unlink(SOCKET_PATH);
+    headless_pixels = NULL;
+    dumb_scanout = false;
 
-        server_fd = -1;
-    }
+    ui_raster_destroy();
 }
 
-int init() {
-    drm_fd = open("/dev/dri/card0", O_RDWR | O_CLOEXEC);
+void cleanup() {
+    printf("  II: (compositor.c) cleanup() -> cleaning up...\n");
 
-    if (drm_fd == -1) {
-        printf("  EE: (compositor.c) init() -> failed to open '/dev/dri/card0'\n  %s\n", strerror(errno));
+    flux_pool_destroy();
 
-        return 1;
-    }
+    if (previous_bo) {
+        if (previous_fb)
+            drmModeRmFB(drm_fd, previous_fb);
 
-    printf("  II: (compositor.c) init() -> video card... [OK]\n");
-    
-    if (drmSetMaster(drm_fd) != 0) {
-        printf("  WW: (compositor.c) init() -> failed to become DRM master: %s\n", strerror(errno));
+        gbm_surface_release_buffer(gbm_surface, previous_bo);
 
-        return 1;
+        previous_bo = NULL;
+        previous_fb = 0;
     }
-    
-    printf("  II: (compositor.c) init() -> DRM master... [OK]\n");
 
-    resources = drmModeGetResources(drm_fd);
-    
+    if (orig_crtc) {
+        drmModeSetCrtc(
+            drm_fd,
+            orig_crtc->crtc_id,
+            orig_crtc->buffer_id,
+            orig_crtc->x,
+            orig_crtc->y,
+            &connector->connector_id,
+            1,
+            &orig_crtc->mode
+        );
+
+        drmModeFreeCrtc(orig_crtc);
+
+        orig_crtc = NULL;
+    }
+
+    release_gles();
+    release_raster();
+
+    if (connector) {
+        drmModeFreeConnector(connector);
+
+        connector = NULL;
+    }
+
+    if (encoder) {
+        drmModeFreeEncoder(encoder);
+
+        encoder = NULL;
+    }
+
+    if (resources) {
+        drmModeFreeResources(resources);
+
+        resources = NULL;
+    }
+
+    if (drm_fd >= 0)
+        drmDropMaster(drm_fd);
+
+    if (drm_fd >= 0) {
+        close(drm_fd);
+
+        drm_fd = -1;
+    }
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+
+        epoll_fd = -1;
+    }
+}
+
+int init() {
+    // FLUX_RENDERER=cpu draws with the CPU rasterizer even when there is a GPU to use
+    const char *renderer = getenv("FLUX_RENDERER");
+    bool software = renderer && strcmp(renderer, "cpu") == 0;
+
+    drm_fd = open("/dev/dri/card0", O_RDWR | O_CLOEXEC);
+
+    if (drm_fd == -1) {
+        printf("  EE: (compositor.c) init() -> failed to open '/dev/dri/card0'\n  %s\n", strerror(errno));
+
+        return software ? init_raster() : 1;
+    }
+
+    printf("  II: (compositor.c) init() -> video card... [OK]\n");
+    
+    if (drmSetMaster(drm_fd) != 0) {
+        printf("  WW: (compositor.c) init() -> failed to become DRM master: %s\n", strerror(errno));
+
+        if (!software)
+            return 1;
+
+        close(drm_fd);
+
+        drm_fd = -1;
+
+        return init_raster();
+    }
+    
+    printf("  II: (compositor.c) init() -> DRM master... [OK]\n");
+
+    resources = drmModeGetResources(drm_fd);
+    
     if (!resources) {
         printf("  EE: (compositor.c) init() -> drmModeGetResources failed\n");
 
@@ -533,6 +991,20 @@ int init() {
         return 1;
     }
 
+    if (software)
+        return init_raster();
+
+    if (init_gles() == 0)
+        return 0;
+
+    printf("  WW: (compositor.c) init() -> GLES renderer unavailable, falling back to the CPU renderer\n");
+
+    release_gles();
+
+    return init_raster();
+}
+
+static int init_gles() {
     gbm = gbm_create_device(drm_fd);
 
     if (!gbm) {
@@ -636,12 +1108,31 @@ int init() {
 
     printf("  II: (compositor.c) init() -> EGL config... [OK]\n");
 
-    EGLint context_attrs[] = {
-        EGL_CONTEXT_CLIENT_VERSION, 2,
-        EGL_NONE
-    };
+    EGLint renderable = 0;
+
+    eglGetConfigAttrib(egl_display, egl_config, EGL_RENDERABLE_TYPE, &renderable);
+
+    // GLES3 gets the instanced widget path, anything older keeps the GLES2 renderer
+    if (renderable & EGL_OPENGL_ES3_BIT_KHR) {
+        EGLint context_attrs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE
+        };
 
-    egl_context = eglCreateContext(egl_display, egl_config, EGL_NO_CONTEXT, context_attrs);
+        egl_context = eglCreateContext(egl_display, egl_config, EGL_NO_CONTEXT, context_attrs);
+
+        if (egl_context != EGL_NO_CONTEXT)
+            gles_version = 3;
+    }
+
+    if (egl_context == EGL_NO_CONTEXT) {
+        EGLint context_attrs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE
+        };
+
+        egl_context = eglCreateContext(egl_display, egl_config, EGL_NO_CONTEXT, context_attrs);
+    }
 
     if (egl_context == EGL_NO_CONTEXT) {
         printf("  EE: (compositor.c) init() -> eglCreateContext failed (error: 0x%x)\n", eglGetError());
@@ -649,7 +1140,7 @@ int init() {
         return 1;
     }
 
-    printf("  II: (compositor.c) init() -> EGL context... [OK]\n");
+    printf("  II: (compositor.c) init() -> EGL context (GLES %d)... [OK]\n", gles_version);
     
     EGLint red, green, blue, alpha, native_visual;
 
@@ -750,59 +1241,191 @@ int init() {
 
     printf("  II: (compositor.c) init() -> EGL surface... [OK]\n");
 
-    glEnable(GL_BLEND);
+    gles_backend.instanced = gles_version >= 3;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &gles_backend.max_texture_size);
+
+    ui_backend = &gles_backend;
+
+    ui_set_blend(true);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_STENCIL_TEST);
 
-    program = create_program();
+    program_cache_init();
+
+    if (create_ui_shaders() != 0) {
+        printf("  EE: (compositor.c) init() -> failed to create widget shader programs\n");
+
+        return 1;
+    }
+
+    comp_program = create_comp_program();
 
-    if (!program) {
-        printf("  EE: (compositor.c) init() -> failed to create main shader program\n");
+    if (!comp_program) {
+        printf("  EE: (compositor.c) init() -> failed to create compositor shader program\n");
 
         return 1;
     }
 
-    glUseProgram(program);
+    comp_attr_pos = glGetAttribLocation(comp_program, "a_pos");
+    comp_attr_uv = glGetAttribLocation(comp_program, "a_uv");
+    comp_attr_layer = glGetAttribLocation(comp_program, "a_layer");
+
+    glUseProgram(comp_program);
+
+    for (int i = 0; i < comp_layer_units; i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "u_tex%d", i);
 
-    attr_pos = glGetAttribLocation(program, "pos");
-    uni_color = glGetUniformLocation(program, "color");
-    uni_rect_pos = glGetUniformLocation(program, "rect_pos");
-    uni_rect_size = glGetUniformLocation(program, "rect_size");
-    uni_screen_size = glGetUniformLocation(program, "screen_size");
-    uni_radius = glGetUniformLocation(program, "radius");
-    uni_use_texture = glGetUniformLocation(program, "use_texture");
-    uni_tex = glGetUniformLocation(program, "tex");
+        comp_uni_tex[i] = glGetUniformLocation(comp_program, name);
 
-    text_program = create_text_program();
+        glUniform1i(comp_uni_tex[i], i);
+    }
 
-    if (!text_program) {
-        printf("  EE: (compositor.c) init() -> failed to create text shader program\n");
+    if (ui_stream_init(&ui_geometry_stream, UI_STREAM_SIZE, gles_version >= 3) != 0) {
+        printf("  EE: (compositor.c) init() -> failed to create geometry stream\n");
 
         return 1;
     }
 
-    text_attr_pos = glGetAttribLocation(text_program, "pos");
-    text_attr_uv = glGetAttribLocation(text_program, "uv");
-    text_uni_glyph_pos = glGetUniformLocation(text_program, "glyph_pos");
-    text_uni_glyph_size = glGetUniformLocation(text_program, "glyph_size");
-    text_uni_screen_size = glGetUniformLocation(text_program, "screen_size");
-    text_uni_color = glGetUniformLocation(text_program, "color");
-    text_uni_tex = glGetUniformLocation(text_program, "tex");
+    flux_pool_init(0);
 
-    comp_program = create_comp_program();
+    // FLUX_THREADED_WINDOWS=1 gives every client window its own render thread and context
+    const char *threaded = getenv("FLUX_THREADED_WINDOWS");
 
-    if (!comp_program) {
-        printf("  EE: (compositor.c) init() -> failed to create compositor shader program\n");
+    threaded_windows = threaded && strcmp(threaded, "0") != 0;
+
+    if (threaded_windows)
+        printf("  II: (compositor.c) init() -> client windows render on their own threads\n");
+
+    return 0;
+}
+
+static int create_dumb_buffer(DumbBuffer *buffer, int width, int height) {
+    struct drm_mode_create_dumb create = { .width = width, .height = height, .bpp = 32 };
+
+    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0) {
+        printf("  EE: (compositor.c) create_dumb_buffer() -> DRM_IOCTL_MODE_CREATE_DUMB failed: %s\n", strerror(errno));
 
         return 1;
     }
 
-    comp_attr_pos = glGetAttribLocation(comp_program, "a_pos");
-    comp_uni_tex = glGetAttribLocation(comp_program, "u_tex");
+    buffer->handle = create.handle;
+    buffer->pitch = create.pitch;
+    buffer->size = create.size;
+
+    uint32_t handles[4] = { create.handle };
+    uint32_t strides[4] = { create.pitch };
+    uint32_t offsets[4] = { 0 };
+
+    if (drmModeAddFB2(drm_fd, width, height, DRM_FORMAT_XRGB8888, handles, strides, offsets, &buffer->fb_id, 0) != 0) {
+        printf("  EE: (compositor.c) create_dumb_buffer() -> drmModeAddFB2 failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    struct drm_mode_map_dumb map = { .handle = create.handle };
+
+    if (drmIoctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map) != 0) {
+        printf("  EE: (compositor.c) create_dumb_buffer() -> DRM_IOCTL_MODE_MAP_DUMB failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    void *pixels = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, drm_fd, map.offset);
+
+    if (pixels == MAP_FAILED) {
+        printf("  EE: (compositor.c) create_dumb_buffer() -> mmap failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    buffer->pixels = pixels;
+
+    return 0;
+}
+
+// without a GPU windows are drawn and composed on the CPU; with no display either, frames go
+// to a framebuffer in memory at a fixed size
+static int init_raster() {
+    ui_backend = &raster_backend;
+
+    if (drm_fd < 0) {
+        memset(&headless_mode, 0, sizeof(headless_mode));
+
+        headless_mode.hdisplay = COMP_HEADLESS_WIDTH;
+        headless_mode.vdisplay = COMP_HEADLESS_HEIGHT;
+        headless_mode.vrefresh = 60;
+
+        mode = &headless_mode;
+        headless_pixels = calloc((size_t)mode->hdisplay * mode->vdisplay, sizeof(uint32_t));
+
+        if (!headless_pixels) {
+            printf("  EE: (compositor.c) init_raster() -> allocation failed for headless framebuffer\n");
+
+            return 1;
+        }
+
+        printf("  II: (compositor.c) init_raster() -> headless framebuffer: %dx%d... [OK]\n", mode->hdisplay, mode->vdisplay);
+    } else {
+        for (int i = 0; i < 2; i++) {
+            if (create_dumb_buffer(&dumb_buffers[i], mode->hdisplay, mode->vdisplay) != 0)
+                return 1;
+        }
+
+        printf("  II: (compositor.c) init_raster() -> dumb buffers (XRGB8888)... [OK]\n");
+    }
+
+    flux_pool_init(0);
+
+    return ui_raster_init();
+}
 
-    glGenBuffers(1, &vbo);
+// waits for the flip queued with frame_pending as its data, the one frame that may be in flight
+static int comp_wait_page_flip() {
+    drmEventContext ev = {};
+    ev.version = DRM_EVENT_CONTEXT_VERSION;
+    ev.page_flip_handler = page_flip_handler;
+
+    struct pollfd fds = {
+        .fd = drm_fd,
+        .events = POLLIN,
+    };
+
+    int timeout_count = 0;
+
+    while (frame_pending && timeout_count < 10) {
+        int ret = poll(&fds, 1, 100);
+
+        if (ret < 0) {
+            printf("  EE: (compositor.c) comp_wait_page_flip() -> poll failed: %s\n", strerror(errno));
+
+            break;
+        } else if (ret == 0) {
+            printf("  WW: (compositor.c) comp_wait_page_flip() -> poll timeout waiting for page flip (attempt %d/10)\n", ++timeout_count);
+
+            continue;
+        }
+
+        if (fds.revents & POLLIN) {
+            ret = drmHandleEvent(drm_fd, &ev);
+
+            if (ret) {
+                printf("  EE: (compositor.c) comp_wait_page_flip() -> drmHandleEvent failed: %s\n", strerror(errno));
+
+                break;
+            }
+        }
+    }
+
+    if (frame_pending) {
+        printf("  EE: (compositor.c) comp_wait_page_flip() -> page flip never completed after 10 timeouts\n");
+
+        return 1;
+    }
 
     return 0;
 }
@@ -864,47 +1487,9 @@ int render_frame() {
             return 1;
         }
         
-        drmEventContext ev = {};
-        ev.version = DRM_EVENT_CONTEXT_VERSION;
-        ev.page_flip_handler = page_flip_handler;
-        
-        struct pollfd fds = {
-            .fd = drm_fd,
-            .events = POLLIN,
-        };
-        
-        int timeout_count = 0;
-
-        while (frame_pending && timeout_count < 10) {
-            ret = poll(&fds, 1, 100);
-            
-            if (ret < 0) {
-                printf("  EE: (compositor.c) render_frame() -> poll failed: %s\n", strerror(errno));
-
-                break;
-            } else if (ret == 0) {
-                printf("  WW: (compositor.c) render_frame() -> poll timeout waiting for page flip (attempt %d/10)\n", ++timeout_count);
-
-                continue;
-            }
-            
-            if (fds.revents & POLLIN) {
-                ret = drmHandleEvent(drm_fd, &ev);
-
-                if (ret) {
-                    printf("  EE: (compositor.c) render_frame() -> drmHandleEvent failed: %s\n", strerror(errno));
-                    
-                    break;
-                }
-            }
-        }
-        
-        if (frame_pending) {
-            printf("  EE: (compositor.c) render_frame() -> page flip never completed after 10 timeouts\n");
-            
+        if (comp_wait_page_flip() != 0)
             return 1;
-        }
-        
+
         gbm_surface_release_buffer(gbm_surface, previous_bo);
     }
     
@@ -914,112 +1499,419 @@ int render_frame() {
     return 0;
 }
 
-void comp_draw_texture(GLuint tex) {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, mode->hdisplay, mode->vdisplay);
+static void comp_raster_begin_frame() {
+    if (headless_pixels)
+        ui_raster_set_screen(headless_pixels, mode->hdisplay, mode->vdisplay, mode->hdisplay * sizeof(uint32_t));
+    else
+        ui_raster_set_screen(dumb_buffers[dumb_back].pixels, mode->hdisplay, mode->vdisplay, dumb_buffers[dumb_back].pitch);
+}
 
-    glUseProgram(comp_program);
+// the buffer just drawn is flipped to the screen and the one it replaces is drawn next; a
+// headless framebuffer has nothing to present to
+static int comp_raster_present() {
+    if (headless_pixels)
+        return 0;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glUniform1i(comp_uni_tex, 0);
+    DumbBuffer *buffer = &dumb_buffers[dumb_back];
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(comp_quad), comp_quad, GL_STATIC_DRAW);
+    if (!dumb_scanout) {
+        if (drmModeSetCrtc(drm_fd, crtc_id, buffer->fb_id, 0, 0, &connector->connector_id, 1, mode) != 0) {
+            printf("  EE: (compositor.c) comp_raster_present() -> drmModeSetCrtc failed: %s\n", strerror(errno));
 
-    glEnableVertexAttribArray(comp_attr_pos);
-    glVertexAttribPointer(comp_attr_pos, 2, GL_FLOAT, GL_FALSE, 0, 0);
+            return 1;
+        }
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-}
+        dumb_scanout = true;
+    } else {
+        frame_pending = 1;
 
-void comp_redraw(window_t *window, float dt) {
-    if (!window) {
-        printf("  EE: (compositor.c) comp_redraw() -> attempted to redraw invalid window\n");
-        
-        cleanup();
-        exit(1);
-    }
+        if (drmModePageFlip(drm_fd, crtc_id, buffer->fb_id, DRM_MODE_PAGE_FLIP_EVENT, &frame_pending) != 0) {
+            printf("  EE: (compositor.c) comp_raster_present() -> drmModePageFlip failed: %s\n", strerror(errno));
 
-    if (!ui_window_get_rendered(window))
-        return;
+            frame_pending = 0;
+
+            return 1;
+        }
 
-    ui_call_render_loop(window, dt);
-    ui_render_window(window);
+        if (comp_wait_page_flip() != 0)
+            return 1;
+    }
 
-    GLuint window_tex = ui_window_get_texture(window);
+    dumb_back ^= 1;
 
-    comp_draw_texture(window_tex);
+    return 0;
 }
 
-int comp_create_socket() {
-    server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+static void comp_draw_layers(const CompLayer *layers, int count, bool blend) {
+    float vertices[COMP_MAX_LAYER_UNITS * 6 * 6];
+    float sw = mode->hdisplay;
+    float sh = mode->vdisplay;
+    int n = 0;
 
-    if (server_fd < 0) {
-        printf("  EE: (compositor.c) comp_create_socket() -> failed to create server_fd\n");
+    for (int i = 0; i < count; i++) {
+        const CompLayer *layer = &layers[i];
 
-        return 1;
-    }
+        // screen pixels to NDC, the window texture has its top row at t = 1
+        float x0 = layer->x * 2.0f / sw - 1.0f;
+        float x1 = (layer->x + layer->width) * 2.0f / sw - 1.0f;
+        float y0 = 1.0f - layer->y * 2.0f / sh;
+        float y1 = 1.0f - (layer->y + layer->height) * 2.0f / sh;
 
-    int flags = fcntl(server_fd, F_GETFL, 0);
+        const float corners[6][4] = {
+            { x0, y0, 0, 1 }, { x1, y0, 1, 1 }, { x0, y1, 0, 0 },
+            { x0, y1, 0, 0 }, { x1, y0, 1, 1 }, { x1, y1, 1, 0 },
+        };
 
-    if (flags == -1) {
-        printf("  EE: (compositor.c) comp_create_socket() -> fcntl F_GETFL failed\n");
+        for (int k = 0; k < 6; k++) {
+            memcpy(&vertices[n], corners[k], 4 * sizeof(float));
 
-        return 1;
-    }
+            vertices[n + 4] = i;
+            vertices[n + 5] = layer->opacity;
 
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        printf("  EE: (compositor.c) comp_create_socket() -> fcntl F_SETFL failed\n");
+            n += 6;
+        }
 
-        return 1;
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, ui_window_get_texture(layer->window));
     }
 
-    unlink(SOCKET_PATH);
+    long base = ui_stream_upload(&ui_geometry_stream, vertices, n * sizeof(float));
+
+    if (base < 0)
+        return;
 
-    memset(&addr, 0, sizeof(addr));
+    ui_set_blend(blend);
 
-    addr.sun_family = AF_UNIX;
+    glEnableVertexAttribArray(comp_attr_pos);
+    glEnableVertexAttribArray(comp_attr_uv);
+    glEnableVertexAttribArray(comp_attr_layer);
 
-    strncpy(addr.sun_path, SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    glVertexAttribPointer(comp_attr_pos, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)base);
+    glVertexAttribPointer(comp_attr_uv, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(base + 2 * sizeof(float)));
+    glVertexAttribPointer(comp_attr_layer, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(base + 4 * sizeof(float)));
 
-    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        printf("  EE: (compositor.c) comp_create_socket() -> failed to bind server socket\n");
+    glDrawArrays(GL_TRIANGLES, 0, count * 6);
 
-        return 1;
-    }
+    glDisableVertexAttribArray(comp_attr_pos);
+    glDisableVertexAttribArray(comp_attr_uv);
+    glDisableVertexAttribArray(comp_attr_layer);
+    glActiveTexture(GL_TEXTURE0);
+}
 
-    if (listen(server_fd, 5) < 0) {
-        printf("  EE: (compositor.c) comp_create_socket() -> server failed to listen\n");
+static bool comp_layer_covers(const CompLayer *outer, const CompLayer *inner) {
+    return inner->x >= outer->x && inner->y >= outer->y && inner->x + inner->width <= outer->x + outer->width && inner->y + inner->height <= outer->y + outer->height;
+}
 
-        return 1;
-    }
+static void comp_push_layer(window_t *window) {
+    if (!window || !ui_window_get_rendered(window))
+        return;
 
-    printf("  II: (compositor.c) init() -> API socket... [OK]\n");
+    if (layer_count == layer_capacity) {
+        int capacity = layer_capacity ? layer_capacity * 2 : 16;
+        CompLayer *grown = realloc(compose_layers, capacity * sizeof(CompLayer));
 
-    return 0;
-}
+        if (!grown) {
+            printf("  EE: (compositor.c) comp_push_layer() -> realloc failed for layer list\n");
 
-unsigned long comp_register_window(window_t *window) {
-    if (!window) {
-        printf("  EE: (compositor.c) comp_register_window() -> invalid window\n");
+            return;
+        }
 
-        return 0;
+        compose_layers = grown;
+        layer_capacity = capacity;
     }
 
-    if (registry_count >= MAX_WINDOWS) {
-        printf("  EE: (compositor.c) comp_register_window() -> window registry full\n");
+    CompLayer *layer = &compose_layers[layer_count];
 
-        return 0;
-    }
+    layer->window = window;
+    layer->opacity = ui_window_get_opacity(window);
 
-    unsigned long id = ui_window_get_id(window);
+    ui_window_get_geometry(window, &layer->x, &layer->y, &layer->width, &layer->height);
 
-    window_registry[registry_count].id = id;
-    window_registry[registry_count].window = window;
-    registry_count++;
+    if (layer->opacity <= 0 || layer->width <= 0 || layer->height <= 0)
+        return;
 
-    return id;
+    if (layer->x >= mode->hdisplay || layer->y >= mode->vdisplay || layer->x + layer->width <= 0 || layer->y + layer->height <= 0)
+        return;
+
+    layer_count++;
+}
+
+// the desktop sits at the bottom, mapped client windows follow the stack, system overlays go on top
+static void comp_collect_layers() {
+    layer_count = 0;
+
+    comp_push_layer(sys_ui_win);
+
+    for (uint32_t slot = stack_bottom; slot; slot = window_registry[slot - 1].above) {
+        if (window_registry[slot - 1].mapped)
+            comp_push_layer(window_registry[slot - 1].window);
+    }
+
+    if (menu_open)
+        comp_push_layer(sys_ui_menu_win);
+
+    comp_push_layer(mouse_win);
+}
+
+// hidden windows are polled too, a thread that finished a frame before its window was unmapped
+// still holds the client's dmabuf releases until that frame is taken
+static void comp_poll_windows() {
+    for (uint32_t slot = stack_bottom; slot; slot = window_registry[slot - 1].above)
+        ui_window_poll(window_registry[slot - 1].window);
+}
+
+static void comp_prepare_layer(void *context, int index) {
+    ui_prepare_window(((CompLayer *)context)[index].window);
+}
+
+static void comp_build_layer(void *context, int index) {
+    ui_build_window(((CompLayer *)context)[index].window);
+}
+
+static void comp_gl_begin_frame() {
+    ui_stream_begin_frame(&ui_geometry_stream);
+}
+
+// opaque layers go out with blending off until the first translucent one, after that the
+// rest of the chunk is blended so stacking order is kept
+static void comp_gl_compose(const CompLayer *layers, int count, bool screen_covered) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, mode->hdisplay, mode->vdisplay);
+
+    if (screen_covered)
+        ui_discard_framebuffer(GL_COLOR_EXT);
+    else {
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    glUseProgram(comp_program);
+
+    for (int i = 0; i < count;) {
+        int chunk = 0;
+        bool blend = false;
+
+        while (i + chunk < count && chunk < comp_layer_units) {
+            if (!layers[i + chunk].opaque) {
+                if (chunk > 0 && !blend)
+                    break;
+
+                blend = true;
+            }
+
+            chunk++;
+        }
+
+        comp_draw_layers(&layers[i], chunk, blend);
+
+        i += chunk;
+    }
+
+    ui_stream_end_frame(&ui_geometry_stream);
+}
+
+// a layer that lies entirely under a later opaque one is never rendered or sampled; windows
+// share no state, so their transforms and draw lists are worked out on the pool and only the
+// submission stays on this thread, or moves to the window's own thread when it has one, in
+// which case the layer shows the last frame that thread finished; the backend then puts the
+// remaining layers on screen, on GL in as few draws as there are texture units for
+void comp_compose(float dt) {
+    ui_backend->begin_frame();
+
+    comp_collect_layers();
+
+    for (int i = 0; i < layer_count; i++)
+        ui_call_render_loop(compose_layers[i].window, dt);
+
+    comp_poll_windows();
+
+    flux_pool_run(comp_prepare_layer, compose_layers, layer_count);
+
+    for (int i = 0; i < layer_count; i++)
+        compose_layers[i].opaque = compose_layers[i].opacity >= 1.0f && ui_window_is_opaque(compose_layers[i].window);
+
+    int visible = 0;
+    bool screen_covered = false;
+    const CompLayer screen = { .x = 0, .y = 0, .width = mode->hdisplay, .height = mode->vdisplay };
+
+    for (int i = 0; i < layer_count; i++) {
+        bool covered = false;
+
+        for (int k = i + 1; k < layer_count && !covered; k++)
+            covered = compose_layers[k].opaque && comp_layer_covers(&compose_layers[k], &compose_layers[i]);
+
+        if (covered)
+            continue;
+
+        if (compose_layers[i].opaque && comp_layer_covers(&compose_layers[i], &screen))
+            screen_covered = true;
+
+        compose_layers[visible++] = compose_layers[i];
+    }
+
+    flux_pool_run(comp_build_layer, compose_layers, visible);
+
+    for (int i = 0; i < visible; i++)
+        ui_render_window(compose_layers[i].window);
+
+    ui_backend->compose(compose_layers, visible, screen_covered);
+}
+
+int comp_watch_fd(int fd, event_source_type_t *source, uint32_t events) {
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+
+    event.events = events;
+    event.data.ptr = source;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        printf("  EE: (compositor.c) comp_watch_fd() -> epoll_ctl failed for fd %d: %s\n", fd, strerror(errno));
+
+        return 1;
+    }
+
+    return 0;
+}
+
+int comp_create_event_loop() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd < 0) {
+        printf("  EE: (compositor.c) comp_create_event_loop() -> epoll_create1 failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    if (drm_fd >= 0 && comp_watch_fd(drm_fd, &drm_source, EPOLLIN) != 0)
+        return 1;
+
+    if (comp_watch_fd(input_get_fd(), &input_source, EPOLLIN) != 0)
+        return 1;
+
+    if (comp_watch_fd(ipc_get_fd(), &ipc_source, EPOLLIN) != 0)
+        return 1;
+
+    printf("  II: (compositor.c) init() -> event loop... [OK]\n");
+
+    return 0;
+}
+
+static WindowEntry *comp_lookup_window(unsigned long id) {
+    unsigned long slot = id & WINDOW_ID_INDEX_MASK;
+
+    if (slot == 0 || slot > registry_used)
+        return NULL;
+
+    WindowEntry *entry = &window_registry[slot - 1];
+
+    if (!entry->window || entry->generation != id >> WINDOW_ID_INDEX_BITS)
+        return NULL;
+
+    return entry;
+}
+
+static void comp_unlink_window(WindowEntry *entry) {
+    if (entry->below)
+        window_registry[entry->below - 1].above = entry->above;
+    else
+        stack_bottom = entry->above;
+
+    if (entry->above)
+        window_registry[entry->above - 1].below = entry->below;
+    else
+        stack_top = entry->below;
+
+    entry->below = 0;
+    entry->above = 0;
+}
+
+static void comp_raise_window(WindowEntry *entry) {
+    uint32_t slot = entry - window_registry + 1;
+
+    if (stack_top == slot)
+        return;
+
+    comp_unlink_window(entry);
+
+    entry->below = stack_top;
+
+    if (stack_top)
+        window_registry[stack_top - 1].above = slot;
+    else
+        stack_bottom = slot;
+
+    stack_top = slot;
+}
+
+static window_t *comp_top_mapped_window() {
+    for (uint32_t slot = stack_top; slot; slot = window_registry[slot - 1].below) {
+        if (window_registry[slot - 1].mapped)
+            return window_registry[slot - 1].window;
+    }
+
+    return NULL;
+}
+
+unsigned long comp_register_window(window_t *window, ClientEntry *owner) {
+    if (!window) {
+        printf("  EE: (compositor.c) comp_register_window() -> invalid window\n");
+
+        return 0;
+    }
+
+    uint32_t slot;
+
+    if (registry_free) {
+        slot = registry_free;
+        registry_free = window_registry[slot - 1].next_free;
+    } else {
+        if (registry_used >= WINDOW_ID_INDEX_MASK) {
+            printf("  EE: (compositor.c) comp_register_window() -> window registry full\n");
+
+            return 0;
+        }
+
+        if (registry_used == registry_capacity) {
+            uint32_t capacity = registry_capacity ? registry_capacity * 2 : 64;
+            WindowEntry *grown = realloc(window_registry, capacity * sizeof(WindowEntry));
+
+            if (!grown) {
+                printf("  EE: (compositor.c) comp_register_window() -> realloc failed for window registry\n");
+
+                return 0;
+            }
+
+            window_registry = grown;
+            registry_capacity = capacity;
+        }
+
+        slot = ++registry_used;
+        window_registry[slot - 1].generation = 1;
+    }
+
+    WindowEntry *entry = &window_registry[slot - 1];
+
+    entry->window = window;
+    entry->owner = owner;
+    entry->next_free = 0;
+    entry->below = stack_top;
+    entry->above = 0;
+    entry->mapped = false;
+
+    if (stack_top)
+        window_registry[stack_top - 1].above = slot;
+    else
+        stack_bottom = slot;
+
+    stack_top = slot;
+    registry_count++;
+
+    unsigned long id = (entry->generation << WINDOW_ID_INDEX_BITS) | slot;
+
+    ui_window_set_id(window, id);
+
+    return id;
 }
 
 void comp_remove_window(window_t *window) {
@@ -1029,26 +1921,108 @@ void comp_remove_window(window_t *window) {
         return;
     }
 
-    if (registry_count == 0) {
-        printf("  EE: (compositor.c) comp_remove_window() -> window registry empty\n");
+    unsigned long id = ui_window_get_id(window);
+    WindowEntry *entry = comp_lookup_window(id);
+
+    if (!entry || entry->window != window) {
+        printf("  WW: (compositor.c) comp_remove_window() -> window %lu not found\n", id);
+
+        ui_destroy_window(window);
 
         return;
     }
 
-    unsigned long id = ui_window_get_id(window);
+    uint32_t slot = entry - window_registry + 1;
+
+    comp_unlink_window(entry);
+
+    ClientEntry *owner = entry->owner;
+
+    entry->window = NULL;
+    entry->owner = NULL;
+    entry->mapped = false;
+
+    // a slot whose generation is exhausted is retired so its ids are never handed out again
+    if (entry->generation < WINDOW_ID_GENERATION_MAX) {
+        entry->generation++;
+        entry->next_free = registry_free;
+        registry_free = slot;
+    }
+
+    registry_count--;
+
+    if (owner) {
+        ClientUsage *usage = ipc_client_usage(owner);
+
+        usage->windows--;
+        usage->widgets -= ui_window_get_widget_count(window);
+        usage->resources -= ui_window_get_resource_count(window);
+    }
+
+    if (requested_window == window)
+        requested_window = comp_top_mapped_window();
+
+    if (focused_window == window)
+        focused_window = requested_window ? requested_window : sys_ui_win;
 
     ui_destroy_window(window);
+}
 
-    for (int i = 0; i < registry_count; i++) {
-        if (window_registry[i].id == id) {
-            window_registry[i] = window_registry[registry_count];
-            registry_count--;
+void comp_remove_client_windows(ClientEntry *client) {
+    uint32_t next;
 
-            return;
-        }
+    for (uint32_t slot = stack_bottom; slot; slot = next) {
+        WindowEntry *entry = &window_registry[slot - 1];
+
+        next = entry->above;
+
+        if (entry->owner == client)
+            comp_remove_window(entry->window);
+    }
+}
+
+widget_t *comp_get_widget(window_t *window, const char *widget_ref) {
+    if (widget_ref[0] != '#')
+        return ui_window_get_widget(window, widget_ref);
+
+    char *end;
+    unsigned long handle = strtoul(widget_ref + 1, &end, 10);
+
+    if (*end != '\0' || handle == 0 || handle > UINT32_MAX)
+        return NULL;
+
+    return ui_window_get_widget_by_handle(window, handle);
+}
+
+int comp_create_widget(window_t *window, const char *command, uint32_t *handle) {
+    char widget_id[64];
+    widget_type_t widg_type;
+
+    if (sscanf(command, "CREATE_WIDGET:%63[^:]:%u", widget_id, &widg_type) != 2 || widget_id[0] == '#') {
+        printf("  WW: (compositor.c) comp_create_widget() -> invalid CREATE_WIDGET request\n");
+
+        return 1;
+    }
+
+    widget_t *existing = ui_window_get_widget(window, widget_id);
+    widget_t *widget = ui_window_create_widget(window, widget_id, widg_type);
+
+    if (!widget)
+        return 1;
+
+    if (ui_append_widget(window, widget) != 0) {
+        ui_destroy_widget(widget);
+
+        return 1;
     }
 
-    printf("  WW: (compositor.c) comp_remove_window() -> window %lu not found\n", id);
+    // a re-created id replaces the old widget, so free it rather than leaving it in the arena
+    if (existing)
+        ui_destroy_widget(existing);
+
+    *handle = ui_widget_get_handle(widget);
+
+    return 0;
 }
 
 int comp_handle_widget_command(window_t *window, const char *command) {
@@ -1056,17 +2030,15 @@ int comp_handle_widget_command(window_t *window, const char *command) {
     float x, y, w, h;
     int radius;
     char color[32];
+    uint32_t rgba;
     char text[256];
     int font_index;
     int image_index;
-    widget_type_t widg_type;
-
-    if (sscanf(command, "CREATE_WIDGET:%63[^:]:%u", widget_id, &widg_type) == 2) {
-        widget_t *widget = ui_create_widget(widget_id, widg_type);
+    int damage_x, damage_y, damage_w, damage_h;
+    int dmabuf_slot;
 
-        ui_append_widget(window, widget);
-    } else if (sscanf(command, "SET_WIDGET_GEOMETRY:%63[^:]:%f:%f:%f:%f:%d", widget_id, &x, &y, &w, &h, &radius) == 6) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+    if (sscanf(command, "SET_WIDGET_GEOMETRY:%63[^:]:%f:%f:%f:%f:%d", widget_id, &x, &y, &w, &h, &radius) == 6) {
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> SET_WIDGET_GEOMETRY on invalid widget\n");
@@ -1076,7 +2048,7 @@ int comp_handle_widget_command(window_t *window, const char *command) {
 
         ui_widget_set_geometry(widget, x, y, w, h, radius);
     } else if (sscanf(command, "SET_WIDGET_COLOR:%63[^:]:%31s", widget_id, color) == 2) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> SET_WIDGET_COLOR on invalid widget\n");
@@ -1084,9 +2056,19 @@ int comp_handle_widget_command(window_t *window, const char *command) {
             return 1;
         }
 
-        ui_widget_set_color(widget, color);
+        return ui_widget_set_color(widget, color);
+    } else if (sscanf(command, "SET_WIDGET_RGBA:%63[^:]:%8x", widget_id, &rgba) == 2) {
+        widget_t *widget = comp_get_widget(window, widget_id);
+
+        if (!widget) {
+            printf("  WW: (compositor.c) comp_handle_widget_command() -> SET_WIDGET_RGBA on invalid widget\n");
+
+            return 1;
+        }
+
+        ui_widget_set_rgba(widget, rgba);
     } else if (sscanf(command, "SET_WIDGET_TEXT:%63[^:]:%255s", widget_id, text) == 2) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> SET_WIDGET_TEXT on invalid widget\n");
@@ -1096,7 +2078,7 @@ int comp_handle_widget_command(window_t *window, const char *command) {
 
         ui_widget_set_text(widget, text);
     } else if (sscanf(command, "SET_WIDGET_IMAGE:%63[^:]:%d", widget_id, &image_index) == 2) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> SET_WIDGET_IMAGE on invalid widget\n");
@@ -1106,7 +2088,7 @@ int comp_handle_widget_command(window_t *window, const char *command) {
 
         ui_widget_set_image(widget, image_index);
     } else if (sscanf(command, "SET_WIDGET_FONT:%63[^:]:%d", widget_id, &font_index) == 2) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> LOAD_WIDGET_FONT on invalid widget\n");
@@ -1115,8 +2097,28 @@ int comp_handle_widget_command(window_t *window, const char *command) {
         }
 
         ui_widget_set_font(widget, window, font_index);
+    } else if (sscanf(command, "COMMIT_BUFFER:%63[^:]:%d:%d:%d:%d", widget_id, &damage_x, &damage_y, &damage_w, &damage_h) == 5) {
+        widget_t *widget = comp_get_widget(window, widget_id);
+
+        if (!widget) {
+            printf("  WW: (compositor.c) comp_handle_widget_command() -> COMMIT_BUFFER on invalid widget\n");
+
+            return 1;
+        }
+
+        ui_widget_commit_buffer(widget, damage_x, damage_y, damage_w, damage_h);
+    } else if (sscanf(command, "PRESENT_DMABUF:%63[^:]:%d", widget_id, &dmabuf_slot) == 2) {
+        widget_t *widget = comp_get_widget(window, widget_id);
+
+        if (!widget) {
+            printf("  WW: (compositor.c) comp_handle_widget_command() -> PRESENT_DMABUF on invalid widget\n");
+
+            return 1;
+        }
+
+        return ui_widget_present_dmabuf(widget, dmabuf_slot);
     } else if (sscanf(command, "REMOVE_WIDGET:%63[^:]", widget_id) == 1) {
-        widget_t *widget = ui_window_get_widget(window, widget_id);
+        widget_t *widget = comp_get_widget(window, widget_id);
 
         if (!widget) {
             printf("  WW: (compositor.c) comp_handle_widget_command() -> REMOVE_WIDGET on invalid widget\n");
@@ -1125,151 +2127,347 @@ int comp_handle_widget_command(window_t *window, const char *command) {
         }
 
         ui_remove_widget(window, widget);
+        ui_destroy_widget(widget);
     }
 
     return 0;
 }
 
 window_t *comp_get_window(unsigned long id) {
-    for (int i = 0; i < registry_count; i++) {
-        if (window_registry[i].id == id)
-            return window_registry[i].window;
-    }
+    WindowEntry *entry = comp_lookup_window(id);
 
-    return NULL;
+    return entry ? entry->window : NULL;
 }
 
-void comp_listen_socket() {
-    int new_client = accept(server_fd, NULL, NULL);
+window_t *comp_get_client_window(ClientEntry *client, unsigned long id) {
+    WindowEntry *entry = comp_lookup_window(id);
 
-    if (new_client >= 0) {
-        if (client_count < MAX_CLIENTS) {
-            int flags = fcntl(new_client, F_GETFL, 0);
+    if (!entry || entry->owner != client)
+        return NULL;
 
-            fcntl(new_client, F_SETFL, flags | O_NONBLOCK);
-            
-            active_clients[client_count++] = new_client;
+    return entry->window;
+}
+
+static void comp_send_reply(ClientEntry *client, const WindowRequest *request, int32_t status, const void *data, size_t size) {
+    bool no_reply = (request->flags & FLUX_REQUEST_NO_REPLY) != 0;
+
+    if (no_reply && status == 0)
+        return;
+
+    WindowReply reply;
+
+    memset(&reply, 0, sizeof(reply));
+
+    reply.seq = request->seq;
+    reply.type = no_reply ? FLUX_REPLY_ERROR_EVENT : FLUX_REPLY_RESULT;
+    reply.status = status;
+    reply.size = size < sizeof(reply.data) ? size : sizeof(reply.data);
+
+    if (data)
+        memcpy(reply.data, data, reply.size);
+
+    ipc_send_reply(client, &reply);
+}
+
+static void comp_reply_ok(ClientEntry *client, const WindowRequest *request) {
+    comp_send_reply(client, request, 0, NULL, 0);
+}
+
+static void comp_reply_value(ClientEntry *client, const WindowRequest *request, const void *data, size_t size) {
+    comp_send_reply(client, request, 0, data, size);
+}
+
+static void comp_reply_error(ClientEntry *client, const WindowRequest *request, const char *message) {
+    comp_send_reply(client, request, 1, message, strlen(message) + 1);
+}
+
+static void comp_close_fds(int *fds, int fd_count) {
+    for (int i = 0; i < fd_count; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+
+        fds[i] = -1;
+    }
+}
+
+static int comp_handle_request(ClientEntry *client, WindowRequest *request, int *fds, int fd_count) {
+    if (strcmp(request->request, "SYNC") == 0) {
+        comp_close_fds(fds, fd_count);
+        comp_reply_ok(client, request);
+
+        return 0;
+    }
+
+    char widget_id[64];
+    int buffer_w, buffer_h;
 
-            printf("  II: comp_listen_socket() -> new client connected (fd: %d)\n", new_client);
+    if (sscanf(request->request, "ATTACH_BUFFER:%63[^:]:%d:%d", widget_id, &buffer_w, &buffer_h) == 3) {
+        window_t *window = comp_get_client_window(client, request->id);
+        widget_t *widget = window ? comp_get_widget(window, widget_id) : NULL;
+
+        if (!widget || fd_count != 1 || ui_widget_attach_buffer(widget, fds[0], buffer_w, buffer_h) != 0) {
+            printf("  WW: (compositor.c) comp_handle_request() -> ATTACH_BUFFER failed for widget %s\n", widget_id);
+
+            comp_reply_error(client, request, "ATTACH_BUFFER: buffer rejected");
         } else
-            close(new_client);
+            comp_reply_ok(client, request);
+
+        comp_close_fds(fds, fd_count);
+
+        return 0;
     }
 
-    for (int i = 0; i < client_count; i++) {
-        WindowRequest request;
-        ssize_t bytes = recv(active_clients[i], &request, sizeof(request), 0);
+    dmabuf_desc_t dmabuf;
+    unsigned long long modifier;
 
-        if (bytes == sizeof(request)) {
-            printf("  II: (compositor.c) comp_listen_socket() -> request received: %s\n", request.request);
+    if (sscanf(request->request, "ATTACH_DMABUF:%63[^:]:%d:%d:%u:%u:%u:%llx", widget_id, &dmabuf.width, &dmabuf.height, &dmabuf.fourcc, &dmabuf.stride, &dmabuf.offset, &modifier) == 7) {
+        window_t *window = comp_get_client_window(client, request->id);
+        widget_t *widget = window ? comp_get_widget(window, widget_id) : NULL;
+        int slot = -1;
 
-            if (strcmp(request.request, "CREATE_WINDOW") == 0) {
-                window_t *new_win = ui_create_window();
+        if (widget && (fd_count == 1 || fd_count == 2)) {
+            dmabuf.fd = fds[0];
+            dmabuf.modifier = modifier;
 
-                unsigned long id = comp_register_window(new_win);
+            slot = ui_widget_attach_dmabuf(widget, &dmabuf, fd_count == 2 ? fds[1] : -1);
 
-                send(active_clients[i], &id, sizeof(id), 0);
-            } else {
-                window_t *window = comp_get_window(request.id);
-                char font_file[128];
-                int font_size = 0;
-                char image_file[128];
-                int widget_status = -1;
-
-                if (window) {
-                    if (strcmp(request.request, "RENDER") == 0)
-                        requested_window = window;
-                    else if (strcmp(request.request, "SHOW") == 0)
-                        ui_request_render(window);
-                    else if (strcmp(request.request, "HIDE") == 0)
-                        ui_request_hide(window);
-                    else if (strcmp(request.request, "GET_SCREEN_SIZE") == 0) {
-                        struct {
-                            int w;
-                            int h;
-                        } response;
-
-                        response.w = mode->hdisplay;
-                        response.h = mode->vdisplay;
-
-                        send(active_clients[i], &response, sizeof(response), 0);
-
-                        return;
-                    } else if (strncmp(request.request, "LOAD_FONT:", 10) == 0) {
-                        if (sscanf("LOAD_FONT:%63[^:]:%d", font_file, font_size) == 2) {
-                            int font = ui_load_font(window, font_file, font_size);
-
-                            send(active_clients[i], &font, sizeof(font), 0);
-
-                            return;
-                        }
-                    } else if (strncmp(request.request, "LOAD_TEXTURE:", 13) == 0) {
-                        if (sscanf("LOAD_TEXTURE:%63[^:]", image_file) == 1) {
-                            int image = ui_load_texture(window, image_file);
-
-                            send(active_clients[i], &image, sizeof(image), 0);
-
-                            return;
-                        }
-                    } else if (strncmp(request.request, "CREATE_WIDGET:", 14) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SET_WIDGET_GEOMETRY:", 20) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SET_WIDGET_COLOR:", 17) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SET_WIDGET_TEXT:", 16) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SET_WIDGET_IMAGE:", 17) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SET_WIDGET_FONT:", 16) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "REMOVE_WIDGET:", 14) == 0)
-                        widget_status = comp_handle_widget_command(window, request.request);
-                    else if (strncmp(request.request, "SHUTDOWN", 9) == 0) {
-                        comp_remove_window(window);
-                        close(active_clients[i]);
-
-                        active_clients[i] = active_clients[--client_count];
-                        i--;
-
-                        requested_window = window_registry[registry_count].window;
-                    } else {
-                        printf("  EE: (compositor.c) comp_listen_socket() -> invalid command from window ID %lu\n", request.id);
-
-                        const char *err = "ERROR: invalid command";
-
-                        send(active_clients[i], err, strlen(err), 0);
-
-                        return;
-                    }
-
-                    if (widget_status == 1) {
-                        const char *err = "ERROR: widget command failed";
-
-                        send(active_clients[i], err, strlen(err), 0);
-                    }
-
-                    send(active_clients[i], "OK", 2, 0);
-                } else {
-                    printf("  EE: (compositor.c) comp_listen_socket() -> window ID %lu not found\n", request.id);
-
-                    const char *err = "ERROR: invalid window";
-
-                    send(active_clients[i], err, strlen(err), 0);
-                }
-            }
-        } else if (bytes == 0) {
-            printf("  II: (compositor.c) comp_listen_socket() -> client disconnected (fd: %d)\n", active_clients[i]);
+            if (slot >= 0 && fd_count == 2)
+                fds[1] = -1;
+        }
+
+        if (slot < 0) {
+            printf("  WW: (compositor.c) comp_handle_request() -> ATTACH_DMABUF failed for widget %s\n", widget_id);
+
+            comp_reply_error(client, request, "ATTACH_DMABUF: dmabuf rejected");
+        } else
+            comp_reply_value(client, request, &slot, sizeof(slot));
+
+        comp_close_fds(fds, fd_count);
+
+        return 0;
+    }
+
+    comp_close_fds(fds, fd_count);
+
+    ClientUsage *usage = ipc_client_usage(client);
+
+    if (strcmp(request->request, "CREATE_WINDOW") == 0) {
+        if (usage->windows >= MAX_CLIENT_WINDOWS) {
+            comp_reply_error(client, request, "CREATE_WINDOW: window quota exceeded");
+
+            return 0;
+        }
+
+        window_t *new_win = ui_create_window();
 
-            close(active_clients[i]);
+        ui_window_set_depth_prepass(new_win, true);
 
-            active_clients[i] = active_clients[--client_count];
-            i--;
+        if (threaded_windows)
+            ui_window_set_threaded(new_win, true);
+
+        unsigned long id = comp_register_window(new_win, client);
+
+        if (id == 0) {
+            ui_destroy_window(new_win);
+            comp_reply_error(client, request, "CREATE_WINDOW: window registry full");
+
+            return 0;
         }
+
+        usage->windows++;
+
+        comp_reply_value(client, request, &id, sizeof(id));
+
+        return 0;
+    }
+
+    window_t *window = comp_get_client_window(client, request->id);
+    char font_file[128];
+    int font_size = 0;
+    char image_file[128];
+    int widget_status = -1;
+    int win_x, win_y, win_w, win_h;
+    float opacity;
+
+    if (!window) {
+        printf("  EE: (compositor.c) comp_handle_request() -> window ID %lu not found\n", request->id);
+
+        comp_reply_error(client, request, "invalid window");
+
+        return 0;
+    }
+
+    if (strcmp(request->request, "RENDER") == 0) {
+        WindowEntry *entry = comp_lookup_window(request->id);
+
+        entry->mapped = true;
+
+        comp_raise_window(entry);
+
+        requested_window = window;
+    } else if (sscanf(request->request, "SET_WINDOW_GEOMETRY:%d:%d:%d:%d", &win_x, &win_y, &win_w, &win_h) == 4) {
+        if (win_w <= 0 || win_h <= 0 || win_w > MAX_WINDOW_SIZE || win_h > MAX_WINDOW_SIZE) {
+            comp_reply_error(client, request, "SET_WINDOW_GEOMETRY: invalid size");
+
+            return 0;
+        }
+
+        ui_window_set_geometry(window, win_x, win_y, win_w, win_h);
+    } else if (sscanf(request->request, "SET_WINDOW_OPACITY:%f", &opacity) == 1) {
+        if (!(opacity >= 0.0f && opacity <= 1.0f)) {
+            comp_reply_error(client, request, "SET_WINDOW_OPACITY: out of range");
+
+            return 0;
+        }
+
+        ui_window_set_opacity(window, opacity);
+    } else if (strcmp(request->request, "SHOW") == 0)
+        ui_request_render(window);
+    else if (strcmp(request->request, "HIDE") == 0)
+        ui_request_hide(window);
+    else if (strcmp(request->request, "GET_SCREEN_SIZE") == 0) {
+        struct {
+            int w;
+            int h;
+        } response;
+
+        response.w = mode->hdisplay;
+        response.h = mode->vdisplay;
+
+        comp_reply_value(client, request, &response, sizeof(response));
+
+        return 0;
+    } else if (strncmp(request->request, "LOAD_FONT:", 10) == 0) {
+        if (usage->resources >= MAX_CLIENT_RESOURCES) {
+            comp_reply_error(client, request, "LOAD_FONT: resource quota exceeded");
+
+            return 0;
+        }
+
+        if (sscanf(request->request, "LOAD_FONT:%127[^:]:%d", font_file, &font_size) != 2) {
+            comp_reply_error(client, request, "LOAD_FONT: invalid request");
+
+            return 0;
+        }
+
+        int font = ui_load_font(window, font_file, font_size);
+
+        if (font >= 0)
+            usage->resources++;
+
+        comp_reply_value(client, request, &font, sizeof(font));
+
+        return 0;
+    } else if (strncmp(request->request, "LOAD_TEXTURE:", 13) == 0) {
+        if (usage->resources >= MAX_CLIENT_RESOURCES) {
+            comp_reply_error(client, request, "LOAD_TEXTURE: resource quota exceeded");
+
+            return 0;
+        }
+
+        if (sscanf(request->request, "LOAD_TEXTURE:%127[^:]", image_file) != 1) {
+            comp_reply_error(client, request, "LOAD_TEXTURE: invalid request");
+
+            return 0;
+        }
+
+        int image = ui_load_texture(window, image_file);
+
+        if (image >= 0)
+            usage->resources++;
+
+        comp_reply_value(client, request, &image, sizeof(image));
+
+        return 0;
+    } else if (strncmp(request->request, "CREATE_WIDGET:", 14) == 0) {
+        uint32_t handle = 0;
+        int widget_count = ui_window_get_widget_count(window);
+
+        if (usage->widgets >= MAX_CLIENT_WIDGETS) {
+            comp_reply_error(client, request, "CREATE_WIDGET: widget quota exceeded");
+
+            return 0;
+        }
+
+        widget_status = comp_create_widget(window, request->request, &handle);
+        usage->widgets += ui_window_get_widget_count(window) - widget_count;
+
+        if (widget_status == 0) {
+            comp_reply_value(client, request, &handle, sizeof(handle));
+
+            return 0;
+        }
+    } else if (strncmp(request->request, "SET_WIDGET_GEOMETRY:", 20) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SET_WIDGET_COLOR:", 17) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SET_WIDGET_RGBA:", 16) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SET_WIDGET_TEXT:", 16) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SET_WIDGET_IMAGE:", 17) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SET_WIDGET_FONT:", 16) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "REMOVE_WIDGET:", 14) == 0) {
+        int widget_count = ui_window_get_widget_count(window);
+
+        widget_status = comp_handle_widget_command(window, request->request);
+        usage->widgets += ui_window_get_widget_count(window) - widget_count;
+    }
+    else if (strncmp(request->request, "COMMIT_BUFFER:", 14) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "PRESENT_DMABUF:", 15) == 0)
+        widget_status = comp_handle_widget_command(window, request->request);
+    else if (strncmp(request->request, "SHUTDOWN", 9) == 0) {
+        comp_remove_window(window);
+        ipc_close_client(client);
+
+        return 1;
+    } else {
+        printf("  EE: (compositor.c) comp_handle_request() -> invalid command from window ID %lu\n", request->id);
+
+        comp_reply_error(client, request, "invalid command");
+
+        return 0;
+    }
+
+    if (widget_status == 1) {
+        char message[96];
+
+        snprintf(message, sizeof(message), "%.*s: widget command failed", (int)strcspn(request->request, ":"), request->request);
+
+        comp_reply_error(client, request, message);
+
+        return 0;
+    }
+
+    comp_reply_ok(client, request);
+
+    return 0;
+}
+
+void comp_apply_commands() {
+    IpcCommand *command;
+
+    while ((command = ipc_next_command())) {
+        ClientEntry *client = command->client;
+
+        if (command->type == IPC_COMMAND_DISCONNECTED) {
+            comp_remove_client_windows(client);
+            ipc_free_command(command);
+            ipc_release_client(client);
+
+            continue;
+        }
+
+        comp_handle_request(client, &command->request, command->fds, command->fd_count);
+        ipc_free_command(command);
     }
 }
 
 void comp_on_mouse_move(int x, int y) {
-    ui_widget_set_geometry(mouse_cursor, x, y, -1, -1, -1);
+    ui_window_set_geometry(mouse_win, x, y, 24, 24);
 }
 
 void comp_on_mouse_down(int x, int y, uint32_t button) {
@@ -1337,10 +2535,18 @@ int main() {
         running = false;
     }
 
-    int socket_status = comp_create_socket();
+    int ipc_status = ipc_init();
 
-    if (socket_status != 0) {
-        printf("  EE: (compositor.c) main() -> an error occurred in comp_create_socket()\n");
+    if (ipc_status != 0) {
+        printf("  EE: (compositor.c) main() -> an error occurred in ipc_init()\n");
+
+        running = false;
+    }
+
+    int loop_status = comp_create_event_loop();
+
+    if (loop_status != 0) {
+        printf("  EE: (compositor.c) main() -> an error occurred in comp_create_event_loop()\n");
 
         running = false;
     }
@@ -1348,56 +2554,76 @@ int main() {
     sys_ui_win = sys_ui_init();
     sys_ui_menu_win = sys_ui_menu();
 
+    ui_window_set_depth_prepass(sys_ui_win, true);
+
     mouse_win = ui_create_window();
-    mouse_cursor = ui_create_widget("sys-cursor", WIDGET_IMAGE);
+    mouse_cursor = ui_window_create_widget(mouse_win, "sys-cursor", WIDGET_IMAGE);
 
     int cursor_image = ui_load_texture(mouse_win, "assets/cursors/default.png");
 
-    ui_widget_set_geometry(mouse_cursor, mode->hdisplay / 2.0, mode->vdisplay / 2.0, 24, 24, -1);
-    ui_widget_set_color(mouse_cursor, "#ffffffff");
+    // the cursor is its own small layer, moving it never re-renders anything underneath
+    ui_window_set_geometry(mouse_win, mode->hdisplay / 2, mode->vdisplay / 2, 24, 24);
+    ui_widget_set_geometry(mouse_cursor, 0, 0, 24, 24, -1);
+    ui_widget_set_rgba(mouse_cursor, 0xffffffff);
     ui_append_widget(mouse_win, mouse_cursor);
     ui_widget_set_image(mouse_cursor, cursor_image);
     ui_request_render(mouse_win);
 
+    if (running && ipc_start() != 0) {
+        printf("  EE: (compositor.c) main() -> an error occurred in ipc_start()\n");
+
+        running = false;
+    }
+
     struct timespec last_time;
 
     clock_gettime(CLOCK_MONOTONIC, &last_time);
 
-    struct pollfd fds[2];
-    
-    fds[0].fd = drm_fd;
-    fds[0].events = POLLIN;
-    fds[1].fd = input_get_fd();
-    fds[1].events = POLLIN;
+    struct epoll_event events[MAX_EVENTS];
 
     long unsigned int frame_count = 0;
     bool opened = false;
 
     while (running) {
-        int poll_ret = poll(fds, 2, 16);
+        int event_count = epoll_wait(epoll_fd, events, MAX_EVENTS, 16);
 
-        if (poll_ret < 0) {
+        if (event_count < 0) {
             if (errno == EINTR)
                 continue;
 
-            printf("  EE: (compositor.c) main() -> poll failed\n");
+            printf("  EE: (compositor.c) main() -> epoll_wait failed\n");
 
             break;
         }
 
-        if (fds[1].revents & POLLIN)
-            input_process_event();
+        for (int i = 0; i < event_count; i++) {
+            event_source_type_t *source = events[i].data.ptr;
 
-        if (fds[0].revents & POLLIN) {
-            drmEventContext ev = {
-                .version = DRM_EVENT_CONTEXT_VERSION,
-                .page_flip_handler = page_flip_handler
-            };
+            switch (*source) {
+                case EVENT_SOURCE_DRM: {
+                    drmEventContext ev = {
+                        .version = DRM_EVENT_CONTEXT_VERSION,
+                        .page_flip_handler = page_flip_handler
+                    };
 
-            drmHandleEvent(drm_fd, &ev);
-        }
+                    drmHandleEvent(drm_fd, &ev);
 
-        comp_listen_socket();
+                    break;
+                }
+
+                case EVENT_SOURCE_INPUT: {
+                    input_process_event();
+
+                    break;
+                }
+
+                case EVENT_SOURCE_IPC: {
+                    ipc_clear_wake();
+
+                    break;
+                }
+            }
+        }
 
         struct timespec now;
 
@@ -1415,39 +2641,28 @@ int main() {
 
         if (!frame_pending) {
             if (!focused_window) {
-                registry_count = 0;
                 menu_open = false;
                 requested_window = NULL;
                 focused_window = sys_ui_win;
             }
 
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, mode->hdisplay, mode->vdisplay);
-            glClearColor(0, 0, 0, 0);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            if (requested_window)
-                comp_redraw(requested_window, dt);
-            else
-                comp_redraw(sys_ui_win, dt);
-
-            if (menu_open)
-                comp_redraw(sys_ui_menu_win, dt);
+            comp_apply_commands();
+            comp_compose(dt);
 
-            comp_redraw(mouse_win, dt);
-
-            int ret = render_frame();
+            int ret = ui_backend->present();
         
             if (ret != 0) {
-                printf("\n  EE: (compositor.c) main() -> render_frame failed\n");
+                printf("\n  EE: (compositor.c) main() -> presenting the frame failed\n");
                 
                 running = false;
-            }
+            } else
+                ui_flush_dmabuf_releases();
 
             frame_count++;
         }
     }
     
+    ipc_stop();
     cleanup();
     input_cleanup();
 
@@ -2,6 +2,7 @@
 #define COMPOSITOR_H
 
 #include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,6 +25,7 @@
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
 
 typedef EGLSurface (*PFNEGLCREATEPLATFORMWINDOWSURFACEEXTPROC)(
     EGLDisplay dpy,
@@ -46,8 +48,18 @@ typedef EGLSurface (*PFNEGLCREATEPLATFORMWINDOWSURFACEEXTPROC)(
 #endif
 
 #define SOCKET_PATH "/tmp/flux_comp.sock"
-#define MAX_WINDOWS 10
-#define MAX_CLIENTS 10
+#define WINDOW_ID_INDEX_BITS 24
+#define WINDOW_ID_INDEX_MASK ((1ul << WINDOW_ID_INDEX_BITS) - 1)
+#define WINDOW_ID_GENERATION_MAX (ULONG_MAX >> WINDOW_ID_INDEX_BITS)
+#define MAX_EVENTS 64
+#define MAX_REQUEST_FDS 4
+#define MAX_CLIENT_REQUESTS 256
+#define MAX_CLIENT_PENDING 4096
+#define MAX_CLIENT_OUTBOUND (1 << 20)
+#define MAX_CLIENT_WINDOWS 64
+#define MAX_CLIENT_WIDGETS 65536
+#define MAX_CLIENT_RESOURCES 1024
+#define MAX_WINDOW_SIZE 8192
 
 extern int drm_fd;
 extern drmModeRes *resources;
@@ -61,24 +73,7 @@ extern EGLDisplay egl_display;
 extern EGLConfig egl_config;
 extern EGLContext egl_context;
 extern EGLSurface egl_surface;
-extern GLuint program;
-extern GLint attr_pos;
-extern GLint uni_color;
-extern GLint uni_rect_pos;
-extern GLint uni_rect_size;
-extern GLint uni_screen_size;
-extern GLint uni_radius;
-extern GLint uni_use_texture;
-extern GLint uni_tex;
-extern GLuint text_program;
-extern GLint text_attr_pos;
-extern GLint text_attr_uv;
-extern GLint text_uni_glyph_pos;
-extern GLint text_uni_glyph_size;
-extern GLint text_uni_screen_size;
-extern GLint text_uni_color;
-extern GLint text_uni_tex;
-extern GLuint vbo;
+extern int gles_version;
 
 void comp_on_mouse_move(int x, int y);
 void comp_on_mouse_down(int x, int y, uint32_t button);
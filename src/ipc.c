@@ -0,0 +1,1045 @@
+#include "ipc.h"
+#include "../api/flux_ring.h"
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef enum {
+    IPC_SOURCE_SERVER,
+    IPC_SOURCE_WAKE,
+    IPC_SOURCE_CLIENT,
+    IPC_SOURCE_RING
+} ipc_source_type_t;
+
+typedef enum {
+    CLIENT_LIST_READY,
+    CLIENT_LIST_RING,
+    CLIENT_LIST_FLUSH,
+    CLIENT_LIST_COUNT
+} client_list_t;
+
+typedef enum {
+    IPC_MESSAGE_REPLY,
+    IPC_MESSAGE_CLOSE,
+    IPC_MESSAGE_RELEASE
+} ipc_message_type_t;
+
+typedef struct {
+    ipc_source_type_t type;
+    ClientEntry *client;
+} IpcSource;
+
+typedef struct {
+    ClientEntry *prev;
+    ClientEntry *next;
+    bool linked;
+} ClientLink;
+
+typedef struct {
+    flux_queue_node_t node;
+    ipc_message_type_t type;
+    ClientEntry *client;
+    WindowReply reply;
+} IpcMessage;
+
+struct ClientEntry {
+    int fd;
+    size_t index;
+    bool closed;
+    IpcSource socket_source;
+    IpcSource ring_source;
+    ClientLink links[CLIENT_LIST_COUNT];
+
+    _Atomic uint32_t pending;
+    atomic_bool throttled;
+
+    flux_ring_t *ring;
+    size_t ring_bytes;
+    uint32_t ring_capacity;
+    int ring_event_fd;
+    WindowRequest ring_request;
+    bool ring_held;
+    uint32_t next_seq;
+
+    WindowRequest in_request;
+    size_t in_len;
+    int in_fds[MAX_REQUEST_FDS];
+    int in_fd_count;
+
+    unsigned char *out_data;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+
+    ClientUsage usage;
+};
+
+static int server_fd = -1;
+static struct sockaddr_un addr;
+
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static int render_fd = -1;
+static IpcSource server_source = { IPC_SOURCE_SERVER, NULL };
+static IpcSource wake_source = { IPC_SOURCE_WAKE, NULL };
+
+static pthread_t ipc_thread;
+static bool thread_started = false;
+static atomic_bool ipc_running = false;
+static atomic_bool wake_pending = false;
+static atomic_bool render_wake_pending = false;
+
+static flux_queue_t command_queue;
+static flux_queue_t command_pool;
+static flux_queue_t message_queue;
+static bool commands_pushed = false;
+
+static ClientEntry **clients = NULL;
+static size_t client_count = 0;
+static size_t client_capacity = 0;
+static ClientEntry *client_lists[CLIENT_LIST_COUNT];
+
+static int ipc_watch_fd(int fd, IpcSource *source, uint32_t events) {
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+
+    event.events = events;
+    event.data.ptr = source;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        printf("  EE: (ipc.c) ipc_watch_fd() -> epoll_ctl failed for fd %d: %s\n", fd, strerror(errno));
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static void ipc_unwatch_fd(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static void ipc_close_fds(int *fds, int fd_count) {
+    for (int i = 0; i < fd_count; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+
+        fds[i] = -1;
+    }
+}
+
+static void ipc_wake() {
+    if (!atomic_exchange(&wake_pending, true))
+        eventfd_write(wake_fd, 1);
+}
+
+static void ipc_wake_render() {
+    if (!atomic_exchange(&render_wake_pending, true))
+        eventfd_write(render_fd, 1);
+}
+
+static void ipc_client_list_add(client_list_t list, ClientEntry *client) {
+    ClientLink *link = &client->links[list];
+
+    if (link->linked)
+        return;
+
+    link->prev = NULL;
+    link->next = client_lists[list];
+
+    if (client_lists[list])
+        client_lists[list]->links[list].prev = client;
+
+    client_lists[list] = client;
+    link->linked = true;
+}
+
+static void ipc_client_list_remove(client_list_t list, ClientEntry *client) {
+    ClientLink *link = &client->links[list];
+
+    if (!link->linked)
+        return;
+
+    if (link->prev)
+        link->prev->links[list].next = link->next;
+    else
+        client_lists[list] = link->next;
+
+    if (link->next)
+        link->next->links[list].prev = link->prev;
+
+    link->prev = NULL;
+    link->next = NULL;
+    link->linked = false;
+}
+
+// the render thread clears throttled after releasing a command, so one side always sees the other
+static bool ipc_client_throttled(ClientEntry *client) {
+    if (atomic_load(&client->pending) < MAX_CLIENT_PENDING)
+        return false;
+
+    atomic_store(&client->throttled, true);
+
+    if (atomic_load(&client->pending) < MAX_CLIENT_PENDING) {
+        atomic_store(&client->throttled, false);
+
+        return false;
+    }
+
+    return true;
+}
+
+static int ipc_push_command(ClientEntry *client, ipc_command_type_t type, const WindowRequest *request, int *fds, int fd_count) {
+    IpcCommand *command = (IpcCommand *)flux_queue_pop(&command_pool);
+
+    if (!command)
+        command = malloc(sizeof(IpcCommand));
+
+    if (!command) {
+        printf("  EE: (ipc.c) ipc_push_command() -> malloc failed for command\n");
+
+        ipc_close_fds(fds, fd_count);
+
+        return 1;
+    }
+
+    command->type = type;
+    command->client = client;
+    command->fd_count = fd_count;
+
+    if (request)
+        command->request = *request;
+
+    for (int i = 0; i < fd_count; i++) {
+        command->fds[i] = fds[i];
+
+        fds[i] = -1;
+    }
+
+    if (type == IPC_COMMAND_REQUEST)
+        atomic_fetch_add(&client->pending, 1);
+
+    flux_queue_push(&command_queue, &command->node);
+
+    commands_pushed = true;
+
+    return 0;
+}
+
+static int ipc_queue_reply(ClientEntry *client, const WindowReply *reply) {
+    if (client->closed)
+        return 0;
+
+    if (client->out_len + sizeof(*reply) > client->out_capacity) {
+        if (client->out_sent > 0) {
+            memmove(client->out_data, client->out_data + client->out_sent, client->out_len - client->out_sent);
+
+            client->out_len -= client->out_sent;
+            client->out_sent = 0;
+        }
+    }
+
+    if (client->out_len + sizeof(*reply) > client->out_capacity) {
+        size_t capacity = client->out_capacity ? client->out_capacity * 2 : sizeof(*reply) * 16;
+
+        if (capacity > MAX_CLIENT_OUTBOUND) {
+            printf("  WW: (ipc.c) ipc_queue_reply() -> client is not reading its replies (fd: %d)\n", client->fd);
+
+            return 1;
+        }
+
+        unsigned char *grown = realloc(client->out_data, capacity);
+
+        if (!grown) {
+            printf("  EE: (ipc.c) ipc_queue_reply() -> realloc failed for outbound queue\n");
+
+            return 1;
+        }
+
+        client->out_data = grown;
+        client->out_capacity = capacity;
+    }
+
+    memcpy(client->out_data + client->out_len, reply, sizeof(*reply));
+
+    client->out_len += sizeof(*reply);
+
+    ipc_client_list_add(CLIENT_LIST_FLUSH, client);
+
+    return 0;
+}
+
+static void ipc_reply(ClientEntry *client, const WindowRequest *request, int32_t status, const char *message) {
+    if ((request->flags & FLUX_REQUEST_NO_REPLY) && status == 0)
+        return;
+
+    WindowReply reply;
+
+    memset(&reply, 0, sizeof(reply));
+
+    reply.seq = request->seq;
+    reply.type = (request->flags & FLUX_REQUEST_NO_REPLY) ? FLUX_REPLY_ERROR_EVENT : FLUX_REPLY_RESULT;
+    reply.status = status;
+
+    if (message) {
+        reply.size = strlen(message) + 1 < sizeof(reply.data) ? strlen(message) + 1 : sizeof(reply.data);
+
+        memcpy(reply.data, message, reply.size);
+    }
+
+    ipc_queue_reply(client, &reply);
+}
+
+static void ipc_detach_ring(ClientEntry *client) {
+    if (client->ring) {
+        munmap(client->ring, client->ring_bytes);
+
+        client->ring = NULL;
+        client->ring_bytes = 0;
+        client->ring_capacity = 0;
+        client->ring_held = false;
+    }
+
+    if (client->ring_event_fd >= 0) {
+        ipc_unwatch_fd(client->ring_event_fd);
+        close(client->ring_event_fd);
+
+        client->ring_event_fd = -1;
+    }
+
+    ipc_client_list_remove(CLIENT_LIST_RING, client);
+}
+
+static int ipc_attach_ring(ClientEntry *client, uint32_t capacity, int *fds, int fd_count) {
+    if (fd_count != 2) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> expected a memfd and an eventfd\n");
+
+        return 1;
+    }
+
+    if (client->ring || !flux_ring_valid_capacity(capacity)) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> invalid ring request (fd: %d)\n", client->fd);
+
+        return 1;
+    }
+
+    size_t bytes = flux_ring_size(capacity);
+    struct stat st;
+
+    if (fstat(fds[0], &st) != 0 || (size_t)st.st_size < bytes) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> shared memory is smaller than the ring\n");
+
+        return 1;
+    }
+
+    int seals = fcntl(fds[0], F_GET_SEALS);
+
+    if (seals == -1 || !(seals & F_SEAL_SHRINK)) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> shared memory must be sealed against shrinking\n");
+
+        return 1;
+    }
+
+    flux_ring_t *ring = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+
+    if (ring == MAP_FAILED) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> mmap failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    if (ring->capacity != capacity) {
+        printf("  EE: (ipc.c) ipc_attach_ring() -> ring header does not match request\n");
+
+        munmap(ring, bytes);
+
+        return 1;
+    }
+
+    close(fds[0]);
+
+    fds[0] = -1;
+
+    client->ring = ring;
+    client->ring_bytes = bytes;
+    client->ring_capacity = capacity;
+    client->ring_event_fd = fds[1];
+
+    fds[1] = -1;
+
+    if (ipc_watch_fd(client->ring_event_fd, &client->ring_source, EPOLLIN | EPOLLET) != 0) {
+        ipc_detach_ring(client);
+
+        return 1;
+    }
+
+    ipc_client_list_add(CLIENT_LIST_RING, client);
+
+    printf("  II: (ipc.c) ipc_attach_ring() -> command ring attached (fd: %d, slots: %u)\n", client->fd, capacity);
+
+    return 0;
+}
+
+static int ipc_add_client(int fd) {
+    if (client_count == client_capacity) {
+        size_t capacity = client_capacity ? client_capacity * 2 : 16;
+        ClientEntry **grown = realloc(clients, capacity * sizeof(ClientEntry *));
+
+        if (!grown) {
+            printf("  EE: (ipc.c) ipc_add_client() -> realloc failed for client table\n");
+
+            return 1;
+        }
+
+        clients = grown;
+        client_capacity = capacity;
+    }
+
+    ClientEntry *client = calloc(1, sizeof(ClientEntry));
+
+    if (!client) {
+        printf("  EE: (ipc.c) ipc_add_client() -> calloc failed for client\n");
+
+        return 1;
+    }
+
+    client->fd = fd;
+    client->index = client_count;
+    client->ring_event_fd = -1;
+    client->socket_source.type = IPC_SOURCE_CLIENT;
+    client->socket_source.client = client;
+    client->ring_source.type = IPC_SOURCE_RING;
+    client->ring_source.client = client;
+
+    if (ipc_watch_fd(fd, &client->socket_source, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) != 0) {
+        free(client);
+
+        return 1;
+    }
+
+    clients[client_count++] = client;
+
+    printf("  II: (ipc.c) ipc_add_client() -> new client connected (fd: %d)\n", fd);
+
+    return 0;
+}
+
+// the entry stays allocated until the render thread has seen IPC_COMMAND_DISCONNECTED and released it
+static void ipc_drop_client(ClientEntry *client) {
+    if (client->closed)
+        return;
+
+    printf("  II: (ipc.c) ipc_drop_client() -> client disconnected (fd: %d)\n", client->fd);
+
+    ipc_detach_ring(client);
+    ipc_close_fds(client->in_fds, client->in_fd_count);
+    ipc_unwatch_fd(client->fd);
+    close(client->fd);
+
+    for (int i = 0; i < CLIENT_LIST_COUNT; i++)
+        ipc_client_list_remove(i, client);
+
+    ClientEntry *last = clients[--client_count];
+
+    clients[client->index] = last;
+    last->index = client->index;
+
+    client->closed = true;
+    client->in_fd_count = 0;
+
+    ipc_push_command(client, IPC_COMMAND_DISCONNECTED, NULL, NULL, 0);
+}
+
+static void ipc_free_client(ClientEntry *client) {
+    free(client->out_data);
+    free(client);
+}
+
+// the client numbers every request in one sequence whichever way it sends it, wrapping past 0
+static uint32_t ipc_seq_after(uint32_t seq) {
+    seq++;
+
+    return seq ? seq : 1;
+}
+
+static bool ipc_seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// ring and socket are merged back into the client's order: a ring entry waits while the request
+// numbered before it has not come off the socket yet, and when a socket request is in hand only
+// the ring entries sent before it go first
+static bool ipc_ring_turn(ClientEntry *client, const WindowRequest *socket_request) {
+    uint32_t seq = client->ring_request.seq;
+
+    if (socket_request)
+        return ipc_seq_before(seq, socket_request->seq);
+
+    return seq == client->next_seq || ipc_seq_before(seq, client->next_seq);
+}
+
+// returns 1 when the client was throttled before the ring ran dry
+static int ipc_drain_ring(ClientEntry *client, bool throttle, const WindowRequest *socket_request) {
+    if (!client->ring)
+        return 0;
+
+    uint32_t drained = 0;
+    int status = 1;
+
+    while (drained < client->ring_capacity) {
+        if (throttle && ipc_client_throttled(client))
+            return 1;
+
+        if (!client->ring_held) {
+            status = flux_ring_pop(client->ring, client->ring_capacity, &client->ring_request);
+
+            if (status == 0)
+                break;
+
+            if (status < 0) {
+                printf("  EE: (ipc.c) ipc_drain_ring() -> corrupt command ring, detaching (fd: %d)\n", client->fd);
+
+                ipc_detach_ring(client);
+
+                return 0;
+            }
+
+            client->ring_held = true;
+        }
+
+        if (!ipc_ring_turn(client, socket_request)) {
+            status = 0;
+
+            break;
+        }
+
+        client->ring_held = false;
+        client->ring_request.flags |= FLUX_REQUEST_NO_REPLY;
+        client->next_seq = ipc_seq_after(client->ring_request.seq);
+
+        ipc_push_command(client, IPC_COMMAND_REQUEST, &client->ring_request, NULL, 0);
+
+        drained++;
+    }
+
+    // a held entry waiting on the socket is picked up again once that request has been read
+    if (status == 0) {
+        ipc_client_list_remove(CLIENT_LIST_RING, client);
+
+        if (!client->ring_held && !flux_ring_empty(client->ring))
+            ipc_client_list_add(CLIENT_LIST_RING, client);
+    }
+
+    return 0;
+}
+
+static ssize_t ipc_recv_request(ClientEntry *client) {
+    char control[CMSG_SPACE(sizeof(int) * MAX_REQUEST_FDS)];
+    struct iovec iov = {
+        .iov_base = (char *)&client->in_request + client->in_len,
+        .iov_len = sizeof(WindowRequest) - client->in_len
+    };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t bytes = recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC);
+
+    if (bytes <= 0)
+        return bytes;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *received = (int *)CMSG_DATA(cmsg);
+
+        for (int i = 0; i < count; i++) {
+            if (client->in_fd_count < MAX_REQUEST_FDS)
+                client->in_fds[client->in_fd_count++] = received[i];
+            else
+                close(received[i]);
+        }
+    }
+
+    client->in_len += bytes;
+
+    return bytes;
+}
+
+static void ipc_decode_request(ClientEntry *client, WindowRequest *request, int *fds, int fd_count) {
+    unsigned int capacity = 0;
+
+    if (sscanf(request->request, "ATTACH_RING:%u", &capacity) == 1) {
+        if (ipc_attach_ring(client, capacity, fds, fd_count) != 0)
+            ipc_reply(client, request, 1, "ATTACH_RING: ring rejected");
+        else
+            ipc_reply(client, request, 0, NULL);
+
+        ipc_close_fds(fds, fd_count);
+
+        return;
+    }
+
+    ipc_push_command(client, IPC_COMMAND_REQUEST, request, fds, fd_count);
+}
+
+// returns 1 when the client still has unread input
+static int ipc_read_client(ClientEntry *client) {
+    for (int handled = 0; handled < MAX_CLIENT_REQUESTS; handled++) {
+        if (ipc_client_throttled(client))
+            return 1;
+
+        ssize_t bytes = ipc_recv_request(client);
+
+        if (bytes == 0) {
+            ipc_drop_client(client);
+
+            return 0;
+        }
+
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                ipc_client_list_remove(CLIENT_LIST_READY, client);
+
+                return 0;
+            }
+
+            printf("  EE: (ipc.c) ipc_read_client() -> recvmsg failed: %s\n", strerror(errno));
+
+            ipc_drop_client(client);
+
+            return 0;
+        }
+
+        if (client->in_len < sizeof(WindowRequest))
+            continue;
+
+        WindowRequest request = client->in_request;
+        int fds[MAX_REQUEST_FDS];
+        int fd_count = client->in_fd_count;
+
+        memcpy(fds, client->in_fds, sizeof(fds));
+
+        client->in_len = 0;
+        client->in_fd_count = 0;
+
+        request.request[sizeof(request.request) - 1] = '\0';
+
+        printf("  II: (ipc.c) ipc_read_client() -> request %u received: %s\n", request.seq, request.request);
+
+        ipc_drain_ring(client, false, &request);
+        ipc_decode_request(client, &request, fds, fd_count);
+
+        client->next_seq = ipc_seq_after(request.seq);
+
+        if (client->ring && (client->ring_held || !flux_ring_empty(client->ring)))
+            ipc_client_list_add(CLIENT_LIST_RING, client);
+    }
+
+    return 1;
+}
+
+static void ipc_flush_client(ClientEntry *client) {
+    while (client->out_sent < client->out_len) {
+        ssize_t bytes = send(client->fd, client->out_data + client->out_sent, client->out_len - client->out_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            printf("  WW: (ipc.c) ipc_flush_client() -> failed to send replies (fd: %d)\n", client->fd);
+
+            ipc_drop_client(client);
+
+            return;
+        }
+
+        client->out_sent += bytes;
+    }
+
+    client->out_len = 0;
+    client->out_sent = 0;
+
+    ipc_client_list_remove(CLIENT_LIST_FLUSH, client);
+}
+
+static void ipc_accept_clients() {
+    while (1) {
+        int fd = accept4(server_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                printf("  WW: (ipc.c) ipc_accept_clients() -> accept failed: %s\n", strerror(errno));
+
+            return;
+        }
+
+        if (ipc_add_client(fd) != 0)
+            close(fd);
+    }
+}
+
+static void ipc_process_messages() {
+    flux_queue_node_t *node;
+
+    atomic_store(&wake_pending, false);
+
+    while ((node = flux_queue_pop(&message_queue))) {
+        IpcMessage *message = (IpcMessage *)node;
+        ClientEntry *client = message->client;
+
+        switch (message->type) {
+            case IPC_MESSAGE_REPLY: {
+                if (ipc_queue_reply(client, &message->reply) != 0)
+                    ipc_drop_client(client);
+
+                break;
+            }
+
+            case IPC_MESSAGE_CLOSE: {
+                ipc_drop_client(client);
+
+                break;
+            }
+
+            case IPC_MESSAGE_RELEASE: {
+                ipc_free_client(client);
+
+                break;
+            }
+        }
+
+        free(message);
+    }
+}
+
+// returns true when a client was left with work it is allowed to do right away
+static bool ipc_process_clients() {
+    ClientEntry *next;
+    bool busy = false;
+
+    for (ClientEntry *client = client_lists[CLIENT_LIST_RING]; client; client = next) {
+        next = client->links[CLIENT_LIST_RING].next;
+
+        if (ipc_drain_ring(client, true, NULL) == 0 && client->links[CLIENT_LIST_RING].linked)
+            busy = true;
+    }
+
+    for (ClientEntry *client = client_lists[CLIENT_LIST_READY]; client; client = next) {
+        next = client->links[CLIENT_LIST_READY].next;
+
+        if (ipc_read_client(client) && !atomic_load(&client->throttled))
+            busy = true;
+    }
+
+    for (ClientEntry *client = client_lists[CLIENT_LIST_FLUSH]; client; client = next) {
+        next = client->links[CLIENT_LIST_FLUSH].next;
+
+        ipc_flush_client(client);
+    }
+
+    return busy;
+}
+
+static void *ipc_thread_main(void *data) {
+    struct epoll_event events[MAX_EVENTS];
+    sigset_t signals;
+    bool busy = false;
+
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    while (atomic_load(&ipc_running)) {
+        int event_count = epoll_wait(epoll_fd, events, MAX_EVENTS, busy ? 0 : -1);
+
+        if (event_count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            printf("  EE: (ipc.c) ipc_thread_main() -> epoll_wait failed: %s\n", strerror(errno));
+
+            break;
+        }
+
+        for (int i = 0; i < event_count; i++) {
+            IpcSource *source = events[i].data.ptr;
+
+            switch (source->type) {
+                case IPC_SOURCE_SERVER: {
+                    ipc_accept_clients();
+
+                    break;
+                }
+
+                case IPC_SOURCE_WAKE: {
+                    eventfd_t value;
+
+                    eventfd_read(wake_fd, &value);
+
+                    break;
+                }
+
+                case IPC_SOURCE_CLIENT: {
+                    if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                        ipc_client_list_add(CLIENT_LIST_READY, source->client);
+
+                    if (events[i].events & EPOLLOUT)
+                        ipc_client_list_add(CLIENT_LIST_FLUSH, source->client);
+
+                    break;
+                }
+
+                case IPC_SOURCE_RING: {
+                    eventfd_t value;
+
+                    eventfd_read(source->client->ring_event_fd, &value);
+                    ipc_client_list_add(CLIENT_LIST_RING, source->client);
+
+                    break;
+                }
+            }
+        }
+
+        ipc_process_messages();
+
+        busy = ipc_process_clients();
+
+        if (commands_pushed) {
+            commands_pushed = false;
+
+            ipc_wake_render();
+        }
+    }
+
+    return NULL;
+}
+
+int ipc_init() {
+    flux_queue_init(&command_queue);
+    flux_queue_init(&command_pool);
+    flux_queue_init(&message_queue);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd < 0) {
+        printf("  EE: (ipc.c) ipc_init() -> epoll_create1 failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    render_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (wake_fd < 0 || render_fd < 0) {
+        printf("  EE: (ipc.c) ipc_init() -> failed to create wake eventfds\n");
+
+        return 1;
+    }
+
+    if (ipc_watch_fd(wake_fd, &wake_source, EPOLLIN | EPOLLET) != 0)
+        return 1;
+
+    server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (server_fd < 0) {
+        printf("  EE: (ipc.c) ipc_init() -> failed to create server_fd\n");
+
+        return 1;
+    }
+
+    unlink(SOCKET_PATH);
+
+    memset(&addr, 0, sizeof(addr));
+
+    addr.sun_family = AF_UNIX;
+
+    strncpy(addr.sun_path, SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+    if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("  EE: (ipc.c) ipc_init() -> failed to bind server socket\n");
+
+        return 1;
+    }
+
+    if (listen(server_fd, SOMAXCONN) < 0) {
+        printf("  EE: (ipc.c) ipc_init() -> server failed to listen\n");
+
+        return 1;
+    }
+
+    if (ipc_watch_fd(server_fd, &server_source, EPOLLIN | EPOLLET) != 0)
+        return 1;
+
+    printf("  II: (ipc.c) init() -> API socket... [OK]\n");
+
+    return 0;
+}
+
+int ipc_start() {
+    atomic_store(&ipc_running, true);
+
+    if (pthread_create(&ipc_thread, NULL, ipc_thread_main, NULL) != 0) {
+        printf("  EE: (ipc.c) ipc_start() -> failed to create IPC thread\n");
+
+        atomic_store(&ipc_running, false);
+
+        return 1;
+    }
+
+    thread_started = true;
+
+    printf("  II: (ipc.c) init() -> IPC thread... [OK]\n");
+
+    return 0;
+}
+
+void ipc_stop() {
+    if (thread_started) {
+        atomic_store(&ipc_running, false);
+        eventfd_write(wake_fd, 1);
+        pthread_join(ipc_thread, NULL);
+
+        thread_started = false;
+    }
+
+    flux_queue_node_t *node;
+
+    while ((node = flux_queue_pop(&command_queue))) {
+        IpcCommand *command = (IpcCommand *)node;
+
+        ipc_close_fds(command->fds, command->fd_count);
+        free(command);
+    }
+
+    while ((node = flux_queue_pop(&command_pool)))
+        free(node);
+
+    while ((node = flux_queue_pop(&message_queue)))
+        free(node);
+
+    while (client_count > 0) {
+        ClientEntry *client = clients[0];
+
+        ipc_drop_client(client);
+        ipc_free_client(client);
+    }
+
+    while ((node = flux_queue_pop(&command_queue)))
+        free(node);
+
+    free(clients);
+
+    clients = NULL;
+    client_capacity = 0;
+
+    if (server_fd >= 0) {
+        close(server_fd);
+        unlink(SOCKET_PATH);
+
+        server_fd = -1;
+    }
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+
+        epoll_fd = -1;
+    }
+
+    if (wake_fd >= 0) {
+        close(wake_fd);
+
+        wake_fd = -1;
+    }
+
+    if (render_fd >= 0) {
+        close(render_fd);
+
+        render_fd = -1;
+    }
+}
+
+int ipc_get_fd() {
+    return render_fd;
+}
+
+void ipc_clear_wake() {
+    eventfd_t value;
+
+    atomic_store(&render_wake_pending, false);
+
+    eventfd_read(render_fd, &value);
+}
+
+IpcCommand *ipc_next_command() {
+    return (IpcCommand *)flux_queue_pop(&command_queue);
+}
+
+void ipc_free_command(IpcCommand *command) {
+    ClientEntry *client = command->client;
+
+    ipc_close_fds(command->fds, command->fd_count);
+
+    if (command->type == IPC_COMMAND_REQUEST) {
+        atomic_fetch_sub(&client->pending, 1);
+
+        if (atomic_load(&client->throttled) && atomic_exchange(&client->throttled, false))
+            ipc_wake();
+    }
+
+    flux_queue_push(&command_pool, &command->node);
+}
+
+static void ipc_push_message(ClientEntry *client, ipc_message_type_t type, const WindowReply *reply) {
+    IpcMessage *message = malloc(sizeof(IpcMessage));
+
+    if (!message) {
+        printf("  EE: (ipc.c) ipc_push_message() -> malloc failed for message\n");
+
+        return;
+    }
+
+    message->type = type;
+    message->client = client;
+
+    if (reply)
+        message->reply = *reply;
+
+    flux_queue_push(&message_queue, &message->node);
+
+    ipc_wake();
+}
+
+void ipc_send_reply(ClientEntry *client, const WindowReply *reply) {
+    ipc_push_message(client, IPC_MESSAGE_REPLY, reply);
+}
+
+void ipc_close_client(ClientEntry *client) {
+    ipc_push_message(client, IPC_MESSAGE_CLOSE, NULL);
+}
+
+void ipc_release_client(ClientEntry *client) {
+    ipc_push_message(client, IPC_MESSAGE_RELEASE, NULL);
+}
+
+ClientUsage *ipc_client_usage(ClientEntry *client) {
+    return &client->usage;
+}
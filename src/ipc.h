@@ -0,0 +1,46 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "compositor.h"
+#include "lib/flux_queue.h"
+#include "../api/flux_api.h"
+
+typedef struct ClientEntry ClientEntry;
+
+typedef enum {
+    IPC_COMMAND_REQUEST,
+    IPC_COMMAND_DISCONNECTED
+} ipc_command_type_t;
+
+typedef struct {
+    flux_queue_node_t node;
+    ipc_command_type_t type;
+    ClientEntry *client;
+    WindowRequest request;
+    int fds[MAX_REQUEST_FDS];
+    int fd_count;
+} IpcCommand;
+
+// per-client object counts, only touched by the render thread
+typedef struct {
+    int windows;
+    int widgets;
+    int resources;
+} ClientUsage;
+
+int ipc_init();
+int ipc_start();
+void ipc_stop();
+int ipc_get_fd();
+void ipc_clear_wake();
+
+IpcCommand *ipc_next_command();
+void ipc_free_command(IpcCommand *command);
+void ipc_send_reply(ClientEntry *client, const WindowReply *reply);
+void ipc_close_client(ClientEntry *client);
+void ipc_release_client(ClientEntry *client);
+ClientUsage *ipc_client_usage(ClientEntry *client);
+
+#endif
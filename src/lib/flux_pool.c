@@ -0,0 +1,165 @@
+#include "flux_pool.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static pthread_t workers[FLUX_POOL_MAX_THREADS];
+static int worker_count = 0;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+static flux_pool_fn job_fn = NULL;
+static void *job_context = NULL;
+static int job_count = 0;
+static unsigned long job_generation = 0;
+static int job_busy = 0;
+static bool pool_running = false;
+
+// the run's generation in the high half and the next index in the low half, so a worker that
+// copied an older run's job can never take an index handed out for the current one
+static atomic_ullong job_next;
+
+static void pool_drain(unsigned long generation, flux_pool_fn fn, void *context, int count) {
+    unsigned long long tag = (unsigned long long)(uint32_t)generation << 32;
+    unsigned long long next = atomic_load(&job_next);
+
+    while (true) {
+        if ((next & ~0xffffffffull) != tag || (int)(uint32_t)next >= count)
+            return;
+
+        if (!atomic_compare_exchange_weak(&job_next, &next, next + 1))
+            continue;
+
+        fn(context, (int)(uint32_t)next);
+
+        next = atomic_load(&job_next);
+    }
+}
+
+// a worker that wakes after a run finished finds no indices left for its generation and goes
+// back to sleep
+static void *pool_thread_main(void *data) {
+    (void)data;
+
+    unsigned long seen = 0;
+    sigset_t signals;
+
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_mutex_lock(&pool_lock);
+
+    while (true) {
+        while (pool_running && job_generation == seen)
+            pthread_cond_wait(&work_ready, &pool_lock);
+
+        if (!pool_running)
+            break;
+
+        seen = job_generation;
+
+        flux_pool_fn fn = job_fn;
+        void *context = job_context;
+        int count = job_count;
+
+        job_busy++;
+
+        pthread_mutex_unlock(&pool_lock);
+
+        pool_drain(seen, fn, context, count);
+
+        pthread_mutex_lock(&pool_lock);
+
+        if (--job_busy == 0)
+            pthread_cond_signal(&work_done);
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+// threads <= 0 takes one worker per online core besides the calling thread
+int flux_pool_init(int threads) {
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+    if (threads > FLUX_POOL_MAX_THREADS)
+        threads = FLUX_POOL_MAX_THREADS;
+
+    pool_running = true;
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, pool_thread_main, NULL) != 0) {
+            printf("  WW: (flux_pool.c) flux_pool_init() -> failed to create worker %d, continuing with %d\n", i, i);
+
+            break;
+        }
+
+        worker_count++;
+    }
+
+    printf("  II: (flux_pool.c) flux_pool_init() -> %d worker threads... [OK]\n", worker_count);
+
+    return 0;
+}
+
+void flux_pool_destroy() {
+    pthread_mutex_lock(&pool_lock);
+
+    pool_running = false;
+
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < worker_count; i++)
+        pthread_join(workers[i], NULL);
+
+    worker_count = 0;
+}
+
+int flux_pool_size() {
+    return worker_count + 1;
+}
+
+// calls fn for every index in [0, count) and returns once all of them have finished
+void flux_pool_run(flux_pool_fn fn, void *context, int count) {
+    if (count <= 0)
+        return;
+
+    if (count == 1 || worker_count == 0) {
+        for (int i = 0; i < count; i++)
+            fn(context, i);
+
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+
+    job_fn = fn;
+    job_context = context;
+    job_count = count;
+    job_generation++;
+
+    unsigned long generation = job_generation;
+
+    atomic_store(&job_next, (unsigned long long)(uint32_t)generation << 32);
+
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+
+    pool_drain(generation, fn, context, count);
+
+    pthread_mutex_lock(&pool_lock);
+
+    while (job_busy > 0)
+        pthread_cond_wait(&work_done, &pool_lock);
+
+    pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,15 @@
+#ifndef FLUX_POOL_H
+#define FLUX_POOL_H
+
+#define FLUX_POOL_MAX_THREADS 16
+
+typedef void (*flux_pool_fn)(void *context, int index);
+
+// a fixed set of worker threads for parallel loops; the calling thread takes part in every
+// run and hands out indices one at a time, so uneven jobs still spread across all workers
+int flux_pool_init(int threads);
+void flux_pool_destroy();
+int flux_pool_size();
+void flux_pool_run(flux_pool_fn fn, void *context, int count);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef FLUX_QUEUE_H
+#define FLUX_QUEUE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// intrusive multi-producer / single-consumer queue, producers never block and the consumer never locks
+typedef struct flux_queue_node {
+    struct flux_queue_node *_Atomic next;
+} flux_queue_node_t;
+
+typedef struct {
+    flux_queue_node_t *_Atomic head;
+    char head_pad[56];
+    flux_queue_node_t *tail;
+    flux_queue_node_t stub;
+} flux_queue_t;
+
+static inline void flux_queue_init(flux_queue_t *queue) {
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+
+    queue->tail = &queue->stub;
+}
+
+static inline void flux_queue_push(flux_queue_t *queue, flux_queue_node_t *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+
+    flux_queue_node_t *prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// returns NULL when empty, or when a producer is between its exchange and link (it is picked up on the next pop)
+static inline flux_queue_node_t *flux_queue_pop(flux_queue_t *queue) {
+    flux_queue_node_t *tail = queue->tail;
+    flux_queue_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &queue->stub) {
+        if (!next)
+            return NULL;
+
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next) {
+        queue->tail = next;
+
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+        return NULL;
+
+    flux_queue_push(queue, &queue->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (next) {
+        queue->tail = next;
+
+        return tail;
+    }
+
+    return NULL;
+}
+
+#endif
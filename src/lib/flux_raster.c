@@ -0,0 +1,950 @@
+#include "flux_raster.h"
+#include "flux_pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define RASTER_X86
+#define RASTER_AVX2 __attribute__((target("avx2")))
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RASTER_NEON
+#endif
+
+typedef struct {
+    void *pixels;
+    int width, height;
+    int format;
+    int next_free;
+} raster_texture_t;
+
+// span kernels over premultiplied ARGB8888; every set gives bit-identical results, the vector
+// ones only run their main loop on full registers and leave the tail to the scalar code
+typedef struct {
+    const char *name;
+    void (*fill)(uint32_t *dst, uint32_t color, int count);
+    void (*blend_solid)(uint32_t *dst, uint32_t color, int count);
+    void (*blend_mask)(uint32_t *dst, uint32_t color, const uint8_t *mask, int count);
+    void (*blend)(uint32_t *dst, const uint32_t *src, uint32_t alpha, const uint8_t *mask, int count);
+} raster_kernels_t;
+
+typedef struct {
+    raster_texture_t *target;
+    const ui_draw_list_t *list;
+    int tiles_x;
+} raster_draw_job_t;
+
+typedef struct {
+    const ui_layer_t *layers;
+    int count;
+    int tiles_x;
+} raster_compose_job_t;
+
+static raster_texture_t *textures = NULL;
+static int texture_count = 0;
+static int texture_capacity = 0;
+static int free_texture = -1;
+
+// quads per tile in draw order, rebuilt for every window drawn; bin_starts holds the tile
+// offsets followed by the fill cursors
+static int *bin_starts = NULL;
+static int bin_capacity = 0;
+static int *bin_quads = NULL;
+static int bin_quad_capacity = 0;
+static int *quad_cmds = NULL;
+static int quad_cmd_capacity = 0;
+
+static struct {
+    uint32_t *pixels;
+    int width, height;
+    int stride;
+} screen;
+
+static inline uint32_t mul_div255(uint32_t a, uint32_t b) {
+    uint32_t t = a * b + 128;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t pixel_scale(uint32_t p, uint32_t s) {
+    return mul_div255(p >> 24, s) << 24 | mul_div255(p >> 16 & 0xff, s) << 16 | mul_div255(p >> 8 & 0xff, s) << 8 | mul_div255(p & 0xff, s);
+}
+
+// premultiplied channels never exceed alpha, so no channel carries into the next
+static inline uint32_t pixel_over(uint32_t d, uint32_t s) {
+    return s + pixel_scale(d, 255 - (s >> 24));
+}
+
+static inline uint32_t pixel_premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return a << 24 | mul_div255(r, a) << 16 | mul_div255(g, a) << 8 | mul_div255(b, a);
+}
+
+static void fill_scalar(uint32_t *dst, uint32_t color, int count) {
+    for (int i = 0; i < count; i++)
+        dst[i] = color;
+}
+
+static void blend_solid_scalar(uint32_t *dst, uint32_t color, int count) {
+    for (int i = 0; i < count; i++)
+        dst[i] = pixel_over(dst[i], color);
+}
+
+static void blend_mask_scalar(uint32_t *dst, uint32_t color, const uint8_t *mask, int count) {
+    for (int i = 0; i < count; i++) {
+        if (mask[i])
+            dst[i] = pixel_over(dst[i], pixel_scale(color, mask[i]));
+    }
+}
+
+// src scaled by alpha and then by the optional coverage mask, over dst
+static void blend_scalar(uint32_t *dst, const uint32_t *src, uint32_t alpha, const uint8_t *mask, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t s = src[i];
+
+        if (alpha < 255)
+            s = pixel_scale(s, alpha);
+
+        if (mask)
+            s = pixel_scale(s, mask[i]);
+
+        dst[i] = pixel_over(dst[i], s);
+    }
+}
+
+static const raster_kernels_t scalar_kernels = {
+    "scalar", fill_scalar, blend_solid_scalar, blend_mask_scalar, blend_scalar
+};
+
+#ifdef RASTER_X86
+
+// channels are widened to 16-bit lanes, four pixels per register
+static inline __m128i sse2_mul(__m128i a, __m128i b) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static inline __m128i sse2_alpha(__m128i p) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+static inline __m128i sse2_scale(__m128i p, __m128i lo, __m128i hi) {
+    __m128i zero = _mm_setzero_si128();
+
+    return _mm_packus_epi16(sse2_mul(_mm_unpacklo_epi8(p, zero), lo), sse2_mul(_mm_unpackhi_epi8(p, zero), hi));
+}
+
+static inline __m128i sse2_over(__m128i d, __m128i s) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i max = _mm_set1_epi16(255);
+    __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+    __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+    __m128i d_lo = sse2_mul(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(max, sse2_alpha(s_lo)));
+    __m128i d_hi = sse2_mul(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(max, sse2_alpha(s_hi)));
+
+    return _mm_packus_epi16(_mm_add_epi16(s_lo, d_lo), _mm_add_epi16(s_hi, d_hi));
+}
+
+// spreads four mask bytes over the 16-bit channel lanes of the low and high pixel pairs
+static inline void sse2_mask(const uint8_t *mask, __m128i *lo, __m128i *hi) {
+    __m128i zero = _mm_setzero_si128();
+    uint32_t bits;
+
+    memcpy(&bits, mask, sizeof(bits));
+
+    __m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+
+    m = _mm_or_si128(m, _mm_slli_epi32(m, 16));
+
+    *lo = _mm_unpacklo_epi32(m, m);
+    *hi = _mm_unpackhi_epi32(m, m);
+}
+
+static void fill_sse2(uint32_t *dst, uint32_t color, int count) {
+    __m128i c = _mm_set1_epi32(color);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + i), c);
+
+    fill_scalar(dst + i, color, count - i);
+}
+
+static void blend_solid_sse2(uint32_t *dst, uint32_t color, int count) {
+    __m128i c = _mm_set1_epi32(color);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + i), sse2_over(_mm_loadu_si128((__m128i *)(dst + i)), c));
+
+    blend_solid_scalar(dst + i, color, count - i);
+}
+
+static void blend_mask_sse2(uint32_t *dst, uint32_t color, const uint8_t *mask, int count) {
+    __m128i c = _mm_set1_epi32(color);
+    __m128i lo, hi;
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint32_t bits;
+
+        memcpy(&bits, mask + i, sizeof(bits));
+
+        if (!bits)
+            continue;
+
+        sse2_mask(mask + i, &lo, &hi);
+
+        _mm_storeu_si128((__m128i *)(dst + i), sse2_over(_mm_loadu_si128((__m128i *)(dst + i)), sse2_scale(c, lo, hi)));
+    }
+
+    blend_mask_scalar(dst + i, color, mask + i, count - i);
+}
+
+// fully transparent groups leave dst alone and fully opaque ones replace it, both exactly
+static void blend_sse2(uint32_t *dst, const uint32_t *src, uint32_t alpha, const uint8_t *mask, int count) {
+    __m128i factor = _mm_set1_epi16(alpha);
+    __m128i alpha_bits = _mm_set1_epi32(0xff000000);
+    __m128i lo, hi;
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+        if (alpha < 255)
+            s = sse2_scale(s, factor, factor);
+
+        if (mask) {
+            sse2_mask(mask + i, &lo, &hi);
+
+            s = sse2_scale(s, lo, hi);
+        }
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, _mm_setzero_si128())) == 0xffff)
+            continue;
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alpha_bits), alpha_bits)) != 0xffff)
+            s = sse2_over(_mm_loadu_si128((__m128i *)(dst + i)), s);
+
+        _mm_storeu_si128((__m128i *)(dst + i), s);
+    }
+
+    blend_scalar(dst + i, src + i, alpha, mask ? mask + i : NULL, count - i);
+}
+
+static const raster_kernels_t sse2_kernels = {
+    "sse2", fill_sse2, blend_solid_sse2, blend_mask_sse2, blend_sse2
+};
+
+// the same steps on eight pixels; unpacking works within 128-bit lanes, so the low half of a
+// register holds pixels 0, 1, 4, 5 and the high half 2, 3, 6, 7 until they are packed again
+static inline RASTER_AVX2 __m256i avx2_mul(__m256i a, __m256i b) {
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+static inline RASTER_AVX2 __m256i avx2_alpha(__m256i p) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, 0xff), 0xff);
+}
+
+static inline RASTER_AVX2 __m256i avx2_scale(__m256i p, __m256i lo, __m256i hi) {
+    __m256i zero = _mm256_setzero_si256();
+
+    return _mm256_packus_epi16(avx2_mul(_mm256_unpacklo_epi8(p, zero), lo), avx2_mul(_mm256_unpackhi_epi8(p, zero), hi));
+}
+
+static inline RASTER_AVX2 __m256i avx2_over(__m256i d, __m256i s) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i max = _mm256_set1_epi16(255);
+    __m256i s_lo = _mm256_unpacklo_epi8(s, zero);
+    __m256i s_hi = _mm256_unpackhi_epi8(s, zero);
+    __m256i d_lo = avx2_mul(_mm256_unpacklo_epi8(d, zero), _mm256_sub_epi16(max, avx2_alpha(s_lo)));
+    __m256i d_hi = avx2_mul(_mm256_unpackhi_epi8(d, zero), _mm256_sub_epi16(max, avx2_alpha(s_hi)));
+
+    return _mm256_packus_epi16(_mm256_add_epi16(s_lo, d_lo), _mm256_add_epi16(s_hi, d_hi));
+}
+
+static inline RASTER_AVX2 void avx2_mask(const uint8_t *mask, __m256i *lo, __m256i *hi) {
+    __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)mask));
+
+    m = _mm256_or_si256(m, _mm256_slli_epi32(m, 16));
+
+    *lo = _mm256_unpacklo_epi32(m, m);
+    *hi = _mm256_unpackhi_epi32(m, m);
+}
+
+static RASTER_AVX2 void fill_avx2(uint32_t *dst, uint32_t color, int count) {
+    __m256i c = _mm256_set1_epi32(color);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), c);
+
+    fill_scalar(dst + i, color, count - i);
+}
+
+static RASTER_AVX2 void blend_solid_avx2(uint32_t *dst, uint32_t color, int count) {
+    __m256i c = _mm256_set1_epi32(color);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), avx2_over(_mm256_loadu_si256((__m256i *)(dst + i)), c));
+
+    blend_solid_scalar(dst + i, color, count - i);
+}
+
+static RASTER_AVX2 void blend_mask_avx2(uint32_t *dst, uint32_t color, const uint8_t *mask, int count) {
+    __m256i c = _mm256_set1_epi32(color);
+    __m256i lo, hi;
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        uint64_t bits;
+
+        memcpy(&bits, mask + i, sizeof(bits));
+
+        if (!bits)
+            continue;
+
+        avx2_mask(mask + i, &lo, &hi);
+
+        _mm256_storeu_si256((__m256i *)(dst + i), avx2_over(_mm256_loadu_si256((__m256i *)(dst + i)), avx2_scale(c, lo, hi)));
+    }
+
+    blend_mask_scalar(dst + i, color, mask + i, count - i);
+}
+
+static RASTER_AVX2 void blend_avx2(uint32_t *dst, const uint32_t *src, uint32_t alpha, const uint8_t *mask, int count) {
+    __m256i factor = _mm256_set1_epi16(alpha);
+    __m256i alpha_bits = _mm256_set1_epi32(0xff000000);
+    __m256i lo, hi;
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+
+        if (alpha < 255)
+            s = avx2_scale(s, factor, factor);
+
+        if (mask) {
+            avx2_mask(mask + i, &lo, &hi);
+
+            s = avx2_scale(s, lo, hi);
+        }
+
+        if (_mm256_testz_si256(s, s))
+            continue;
+
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, alpha_bits), alpha_bits)) != 0xffffffffu)
+            s = avx2_over(_mm256_loadu_si256((__m256i *)(dst + i)), s);
+
+        _mm256_storeu_si256((__m256i *)(dst + i), s);
+    }
+
+    blend_scalar(dst + i, src + i, alpha, mask ? mask + i : NULL, count - i);
+}
+
+static const raster_kernels_t avx2_kernels = {
+    "avx2", fill_avx2, blend_solid_avx2, blend_mask_avx2, blend_avx2
+};
+
+#endif
+
+#ifdef RASTER_NEON
+
+// eight pixels at a time, split into one register per channel by the structured loads
+static inline uint8x8_t neon_mul(uint8x8_t a, uint8x8_t b) {
+    uint16x8_t t = vaddq_u16(vmull_u8(a, b), vdupq_n_u16(128));
+
+    return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+static inline uint8x8x4_t neon_scale(uint8x8x4_t p, uint8x8_t s) {
+    for (int c = 0; c < 4; c++)
+        p.val[c] = neon_mul(p.val[c], s);
+
+    return p;
+}
+
+static inline uint8x8x4_t neon_over(uint8x8x4_t d, uint8x8x4_t s) {
+    uint8x8_t inverse = vmvn_u8(s.val[3]);
+
+    for (int c = 0; c < 4; c++)
+        d.val[c] = vadd_u8(s.val[c], neon_mul(d.val[c], inverse));
+
+    return d;
+}
+
+static inline uint8x8x4_t neon_color(uint32_t color) {
+    uint8x8x4_t c;
+
+    for (int k = 0; k < 4; k++)
+        c.val[k] = vdup_n_u8(color >> (8 * k) & 0xff);
+
+    return c;
+}
+
+static void fill_neon(uint32_t *dst, uint32_t color, int count) {
+    uint32x4_t c = vdupq_n_u32(color);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        vst1q_u32(dst + i, c);
+
+    fill_scalar(dst + i, color, count - i);
+}
+
+static void blend_solid_neon(uint32_t *dst, uint32_t color, int count) {
+    uint8x8x4_t c = neon_color(color);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        vst4_u8((uint8_t *)(dst + i), neon_over(vld4_u8((uint8_t *)(dst + i)), c));
+
+    blend_solid_scalar(dst + i, color, count - i);
+}
+
+static void blend_mask_neon(uint32_t *dst, uint32_t color, const uint8_t *mask, int count) {
+    uint8x8x4_t c = neon_color(color);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        vst4_u8((uint8_t *)(dst + i), neon_over(vld4_u8((uint8_t *)(dst + i)), neon_scale(c, vld1_u8(mask + i))));
+
+    blend_mask_scalar(dst + i, color, mask + i, count - i);
+}
+
+static void blend_neon(uint32_t *dst, const uint32_t *src, uint32_t alpha, const uint8_t *mask, int count) {
+    uint8x8_t factor = vdup_n_u8(alpha);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+
+        if (alpha < 255)
+            s = neon_scale(s, factor);
+
+        if (mask)
+            s = neon_scale(s, vld1_u8(mask + i));
+
+        vst4_u8((uint8_t *)(dst + i), neon_over(vld4_u8((uint8_t *)(dst + i)), s));
+    }
+
+    blend_scalar(dst + i, src + i, alpha, mask ? mask + i : NULL, count - i);
+}
+
+static const raster_kernels_t neon_kernels = {
+    "neon", fill_neon, blend_solid_neon, blend_mask_neon, blend_neon
+};
+
+#endif
+
+static const raster_kernels_t *kernels = &scalar_kernels;
+
+// FLUX_RASTER_SIMD=0 keeps the scalar kernels, for comparing output against the vector paths
+int ui_raster_init() {
+    const char *simd = getenv("FLUX_RASTER_SIMD");
+
+    kernels = &scalar_kernels;
+
+    if (!simd || strcmp(simd, "0") != 0) {
+#if defined(RASTER_X86)
+        __builtin_cpu_init();
+
+        kernels = __builtin_cpu_supports("avx2") ? &avx2_kernels : &sse2_kernels;
+#elif defined(RASTER_NEON)
+        kernels = &neon_kernels;
+#endif
+    }
+
+    printf("  II: (flux_raster.c) ui_raster_init() -> %s span kernels, %d render threads... [OK]\n", kernels->name, flux_pool_size());
+
+    return 0;
+}
+
+void ui_raster_destroy() {
+    for (int i = 0; i < texture_count; i++)
+        free(textures[i].pixels);
+
+    free(textures);
+    free(bin_starts);
+    free(bin_quads);
+    free(quad_cmds);
+
+    textures = NULL;
+    texture_count = texture_capacity = 0;
+    free_texture = -1;
+    bin_starts = bin_quads = quad_cmds = NULL;
+    bin_capacity = bin_quad_capacity = quad_cmd_capacity = 0;
+}
+
+void ui_raster_set_screen(uint32_t *pixels, int width, int height, int stride) {
+    screen.pixels = pixels;
+    screen.width = width;
+    screen.height = height;
+    screen.stride = stride;
+}
+
+static bool grow_ints(int **array, int *capacity, int needed) {
+    if (needed <= *capacity)
+        return true;
+
+    int grown = *capacity ? *capacity : 256;
+
+    while (grown < needed)
+        grown *= 2;
+
+    int *resized = realloc(*array, grown * sizeof(int));
+
+    if (!resized)
+        return false;
+
+    *array = resized;
+    *capacity = grown;
+
+    return true;
+}
+
+// texture handles are table index + 1, so 0 stays free to mean no texture like it does in GL
+static raster_texture_t *texture_get(GLuint texture) {
+    if (texture == 0 || texture > (GLuint)texture_count || !textures[texture - 1].pixels)
+        return NULL;
+
+    return &textures[texture - 1];
+}
+
+static size_t texel_size(int format) {
+    return format == UI_TEXTURE_ALPHA ? 1 : 4;
+}
+
+GLuint ui_raster_create_texture(int width, int height, int format, const void *pixels) {
+    if (width <= 0 || height <= 0 || width > UI_RASTER_MAX_TEXTURE_SIZE || height > UI_RASTER_MAX_TEXTURE_SIZE)
+        return 0;
+
+    void *storage = calloc((size_t)width * height, texel_size(format));
+
+    if (!storage) {
+        printf("  EE: (flux_raster.c) ui_raster_create_texture() -> allocation failed for %dx%d texture\n", width, height);
+
+        return 0;
+    }
+
+    int slot = free_texture;
+
+    if (slot >= 0)
+        free_texture = textures[slot].next_free;
+    else {
+        if (texture_count == texture_capacity) {
+            int capacity = texture_capacity ? texture_capacity * 2 : 64;
+            raster_texture_t *grown = realloc(textures, capacity * sizeof(raster_texture_t));
+
+            if (!grown) {
+                printf("  EE: (flux_raster.c) ui_raster_create_texture() -> failed to grow texture table\n");
+
+                free(storage);
+
+                return 0;
+            }
+
+            textures = grown;
+            texture_capacity = capacity;
+        }
+
+        slot = texture_count++;
+    }
+
+    raster_texture_t *texture = &textures[slot];
+
+    texture->pixels = storage;
+    texture->width = width;
+    texture->height = height;
+    texture->format = format;
+    texture->next_free = -1;
+
+    if (pixels)
+        ui_raster_update_texture(slot + 1, 0, 0, width, height, width, pixels);
+
+    return slot + 1;
+}
+
+// RGBA bytes in, premultiplied ARGB words out, the layout the span kernels blend in
+void ui_raster_update_texture(GLuint handle, int x, int y, int width, int height, int row_length, const void *pixels) {
+    raster_texture_t *texture = texture_get(handle);
+
+    if (!texture || x < 0 || y < 0 || x + width > texture->width || y + height > texture->height)
+        return;
+
+    if (texture->format == UI_TEXTURE_ALPHA) {
+        for (int row = y; row < y + height; row++)
+            memcpy((uint8_t *)texture->pixels + (size_t)row * texture->width + x, (const uint8_t *)pixels + (size_t)row * row_length + x, width);
+
+        return;
+    }
+
+    for (int row = y; row < y + height; row++) {
+        const uint8_t *src = (const uint8_t *)pixels + ((size_t)row * row_length + x) * 4;
+        uint32_t *dst = (uint32_t *)texture->pixels + (size_t)row * texture->width + x;
+
+        for (int i = 0; i < width; i++, src += 4)
+            dst[i] = pixel_premultiply(src[0], src[1], src[2], src[3]);
+    }
+}
+
+void ui_raster_destroy_texture(GLuint handle) {
+    raster_texture_t *texture = texture_get(handle);
+
+    if (!texture)
+        return;
+
+    free(texture->pixels);
+
+    texture->pixels = NULL;
+    texture->next_free = free_texture;
+
+    free_texture = handle - 1;
+}
+
+int ui_raster_create_target(window_t *window) {
+    window->fbo = 0;
+    window->color_tex = ui_raster_create_texture(window->width, window->height, UI_TEXTURE_RGBA, NULL);
+
+    return window->color_tex ? 0 : 1;
+}
+
+// the handle stays the same, so the window's layer keeps pointing at its target
+void ui_raster_resize_target(window_t *window) {
+    raster_texture_t *texture = texture_get(window->color_tex);
+
+    if (!texture)
+        return;
+
+    uint32_t *pixels = calloc((size_t)window->width * window->height, sizeof(uint32_t));
+
+    if (!pixels) {
+        printf("  EE: (flux_raster.c) ui_raster_resize_target() -> allocation failed for %dx%d target\n", window->width, window->height);
+
+        return;
+    }
+
+    free(texture->pixels);
+
+    texture->pixels = pixels;
+    texture->width = window->width;
+    texture->height = window->height;
+}
+
+void ui_raster_destroy_target(window_t *window) {
+    ui_raster_destroy_texture(window->color_tex);
+
+    window->color_tex = 0;
+}
+
+// a pixel belongs to a quad when its centre does, the same rule GL rasterizes by
+static void quad_pixels(const ui_instance_t *quad, int bounds[4]) {
+    bounds[0] = (int)ceilf(quad->rect[0] - 0.5f);
+    bounds[1] = (int)ceilf(quad->rect[1] - 0.5f);
+    bounds[2] = (int)ceilf(quad->rect[2] - 0.5f);
+    bounds[3] = (int)ceilf(quad->rect[3] - 0.5f);
+}
+
+// coverage of one row of a rounded quad, the widget shader's distance field at pixel centres;
+// rows between the corners are fully covered and return NULL so they take the unmasked path
+static const uint8_t *rounded_mask(const ui_instance_t *quad, int x0, int y, int count, uint8_t *mask) {
+    float half_w = quad->frame[2] * 0.5f;
+    float half_h = quad->frame[3] * 0.5f;
+    float r = quad->radius;
+    float qy = fabsf(y + 0.5f - quad->frame[1] - half_h) - (half_h - r);
+
+    if (qy <= 0)
+        return NULL;
+
+    float cx = x0 + 0.5f - quad->frame[0] - half_w;
+
+    for (int i = 0; i < count; i++, cx += 1.0f) {
+        float qx = fmaxf(fabsf(cx) - (half_w - r), 0.0f);
+        float t = fminf(fmaxf(sqrtf(qx * qx + qy * qy) - r, 0.0f), 1.0f);
+
+        mask[i] = (uint8_t)((1.0f - t * t * (3.0f - 2.0f * t)) * 255.0f + 0.5f);
+    }
+
+    return mask;
+}
+
+// the tiles a quad touches as tx0, ty0, tx1, ty1 inclusive, false when it misses the target
+static bool quad_tiles(const ui_instance_t *quad, const raster_texture_t *target, int range[4]) {
+    int bounds[4];
+
+    quad_pixels(quad, bounds);
+
+    if (bounds[0] >= bounds[2] || bounds[1] >= bounds[3] || bounds[2] <= 0 || bounds[3] <= 0 || bounds[0] >= target->width || bounds[1] >= target->height)
+        return false;
+
+    range[0] = bounds[0] < 0 ? 0 : bounds[0] / UI_RASTER_TILE_SIZE;
+    range[1] = bounds[1] < 0 ? 0 : bounds[1] / UI_RASTER_TILE_SIZE;
+    range[2] = ((bounds[2] > target->width ? target->width : bounds[2]) - 1) / UI_RASTER_TILE_SIZE;
+    range[3] = ((bounds[3] > target->height ? target->height : bounds[3]) - 1) / UI_RASTER_TILE_SIZE;
+
+    return true;
+}
+
+// one quad inside one tile: solid fills and texture copies when nothing shows through,
+// blending otherwise; textures are sampled at the nearest texel
+static void draw_quad(raster_texture_t *target, const int tile[4], const ui_instance_t *quad, const ui_draw_cmd_t *cmd) {
+    int bounds[4];
+
+    quad_pixels(quad, bounds);
+
+    int x0 = bounds[0] > tile[0] ? bounds[0] : tile[0];
+    int y0 = bounds[1] > tile[1] ? bounds[1] : tile[1];
+    int x1 = bounds[2] < tile[2] ? bounds[2] : tile[2];
+    int y1 = bounds[3] < tile[3] ? bounds[3] : tile[3];
+    uint32_t alpha = quad->color[3];
+
+    if (x0 >= x1 || y0 >= y1 || alpha == 0)
+        return;
+
+    int count = x1 - x0;
+    bool textured = cmd->variant & (UI_SHADER_TEXTURE | UI_SHADER_GLYPH);
+    bool rounded = (cmd->variant & UI_SHADER_ROUNDED) && quad->radius > 0;
+    raster_texture_t *texture = textured ? texture_get(cmd->texture) : NULL;
+    uint32_t color = pixel_premultiply(quad->color[0], quad->color[1], quad->color[2], alpha);
+    uint8_t coverage[UI_RASTER_TILE_SIZE];
+    uint8_t glyph[UI_RASTER_TILE_SIZE];
+    uint32_t texels[UI_RASTER_TILE_SIZE];
+    int columns[UI_RASTER_TILE_SIZE];
+    float v = 0, dv = 0;
+
+    if (textured && !texture)
+        return;
+
+    // texel columns are the same on every row, so they are worked out once per quad
+    if (texture) {
+        float du = (quad->uv[2] - quad->uv[0]) / (quad->rect[2] - quad->rect[0]);
+        float u = (quad->uv[0] + (x0 + 0.5f - quad->rect[0]) * du) * texture->width;
+
+        dv = (quad->uv[3] - quad->uv[1]) / (quad->rect[3] - quad->rect[1]);
+        v = quad->uv[1] + (y0 + 0.5f - quad->rect[1]) * dv;
+
+        for (int i = 0; i < count; i++, u += du * texture->width) {
+            int column = (int)floorf(u);
+
+            columns[i] = column < 0 ? 0 : column >= texture->width ? texture->width - 1 : column;
+        }
+    }
+
+    for (int y = y0; y < y1; y++, v += dv) {
+        uint32_t *dst = (uint32_t *)target->pixels + (size_t)y * target->width + x0;
+        const uint8_t *mask = rounded ? rounded_mask(quad, x0, y, count, coverage) : NULL;
+
+        if (!texture) {
+            if (mask)
+                kernels->blend_mask(dst, color, mask, count);
+            else if (alpha == 255)
+                kernels->fill(dst, color, count);
+            else
+                kernels->blend_solid(dst, color, count);
+
+            continue;
+        }
+
+        int row = (int)floorf(v * texture->height);
+
+        row = row < 0 ? 0 : row >= texture->height ? texture->height - 1 : row;
+
+        if (texture->format == UI_TEXTURE_ALPHA) {
+            const uint8_t *src = (const uint8_t *)texture->pixels + (size_t)row * texture->width;
+
+            for (int i = 0; i < count; i++)
+                glyph[i] = mask ? mul_div255(src[columns[i]], mask[i]) : src[columns[i]];
+
+            kernels->blend_mask(dst, color, glyph, count);
+
+            continue;
+        }
+
+        const uint32_t *src = (const uint32_t *)texture->pixels + (size_t)row * texture->width;
+
+        // an unblended run only holds opaque texels under an opaque tint, so they go straight in
+        if (!cmd->blend && !mask) {
+            for (int i = 0; i < count; i++)
+                dst[i] = src[columns[i]];
+
+            continue;
+        }
+
+        for (int i = 0; i < count; i++)
+            texels[i] = src[columns[i]];
+
+        kernels->blend(dst, texels, alpha, mask, count);
+    }
+}
+
+static void draw_tile(void *context, int index) {
+    raster_draw_job_t *job = context;
+    raster_texture_t *target = job->target;
+    const ui_draw_list_t *list = job->list;
+    const ui_instance_t *quads = list->quads;
+    int tile[4];
+
+    tile[0] = index % job->tiles_x * UI_RASTER_TILE_SIZE;
+    tile[1] = index / job->tiles_x * UI_RASTER_TILE_SIZE;
+    tile[2] = tile[0] + UI_RASTER_TILE_SIZE < target->width ? tile[0] + UI_RASTER_TILE_SIZE : target->width;
+    tile[3] = tile[1] + UI_RASTER_TILE_SIZE < target->height ? tile[1] + UI_RASTER_TILE_SIZE : target->height;
+
+    // an opaque window rewrites every pixel, so its tiles start from whatever was there
+    if (!list->opaque) {
+        for (int y = tile[1]; y < tile[3]; y++)
+            kernels->fill((uint32_t *)target->pixels + (size_t)y * target->width + tile[0], 0, tile[2] - tile[0]);
+    }
+
+    for (int k = bin_starts[index]; k < bin_starts[index + 1]; k++) {
+        int quad = bin_quads[k];
+
+        draw_quad(target, tile, &quads[quad], &list->cmds[quad_cmds[quad]]);
+    }
+}
+
+// quads are binned to the tiles they touch in list order, so every tile can be filled on its
+// own thread and still see its quads in painter's order; the list has no depth pass here
+void ui_raster_draw_window(window_t *window) {
+    raster_texture_t *target = texture_get(window->color_tex);
+    ui_draw_list_t *list = &window->draw_list;
+
+    if (!target)
+        return;
+
+    int tiles_x = (target->width + UI_RASTER_TILE_SIZE - 1) / UI_RASTER_TILE_SIZE;
+    int tiles_y = (target->height + UI_RASTER_TILE_SIZE - 1) / UI_RASTER_TILE_SIZE;
+    int tiles = tiles_x * tiles_y;
+    const ui_instance_t *quads = list->quads;
+    int range[4];
+
+    if (!grow_ints(&bin_starts, &bin_capacity, 2 * (tiles + 1)) || !grow_ints(&quad_cmds, &quad_cmd_capacity, list->quad_count)) {
+        printf("  EE: (flux_raster.c) ui_raster_draw_window() -> allocation failed for tile bins\n");
+
+        return;
+    }
+
+    int *cursor = bin_starts + tiles + 1;
+
+    memset(cursor, 0, tiles * sizeof(int));
+
+    for (int c = 0; c < list->cmd_count; c++) {
+        const ui_draw_cmd_t *cmd = &list->cmds[c];
+
+        for (int q = cmd->first; q < cmd->first + cmd->count; q++) {
+            quad_cmds[q] = quad_tiles(&quads[q], target, range) ? c : -1;
+
+            for (int ty = range[1]; quad_cmds[q] >= 0 && ty <= range[3]; ty++) {
+                for (int tx = range[0]; tx <= range[2]; tx++)
+                    cursor[ty * tiles_x + tx]++;
+            }
+        }
+    }
+
+    bin_starts[0] = 0;
+
+    for (int i = 0; i < tiles; i++) {
+        bin_starts[i + 1] = bin_starts[i] + cursor[i];
+        cursor[i] = bin_starts[i];
+    }
+
+    if (!grow_ints(&bin_quads, &bin_quad_capacity, bin_starts[tiles])) {
+        printf("  EE: (flux_raster.c) ui_raster_draw_window() -> allocation failed for tile bins\n");
+
+        return;
+    }
+
+    for (int q = 0; q < list->quad_count; q++) {
+        if (quad_cmds[q] < 0 || !quad_tiles(&quads[q], target, range))
+            continue;
+
+        for (int ty = range[1]; ty <= range[3]; ty++) {
+            for (int tx = range[0]; tx <= range[2]; tx++)
+                bin_quads[cursor[ty * tiles_x + tx]++] = q;
+        }
+    }
+
+    raster_draw_job_t job = { target, list, tiles_x };
+
+    flux_pool_run(draw_tile, &job, tiles);
+}
+
+static bool layer_covers(const ui_layer_t *layer, const int tile[4]) {
+    return layer->x <= tile[0] && layer->y <= tile[1] && layer->x + layer->width >= tile[2] && layer->y + layer->height >= tile[3];
+}
+
+// a tile is put together in a local buffer and written to the screen once, since scanout
+// memory is usually write-combined and slow to read back; it starts from the topmost opaque
+// layer that covers it, so nothing underneath is ever blended
+static void compose_tile(void *context, int index) {
+    raster_compose_job_t *job = context;
+    uint32_t pixels[UI_RASTER_TILE_SIZE * UI_RASTER_TILE_SIZE];
+    int tile[4];
+
+    tile[0] = index % job->tiles_x * UI_RASTER_TILE_SIZE;
+    tile[1] = index / job->tiles_x * UI_RASTER_TILE_SIZE;
+    tile[2] = tile[0] + UI_RASTER_TILE_SIZE < screen.width ? tile[0] + UI_RASTER_TILE_SIZE : screen.width;
+    tile[3] = tile[1] + UI_RASTER_TILE_SIZE < screen.height ? tile[1] + UI_RASTER_TILE_SIZE : screen.height;
+
+    int width = tile[2] - tile[0];
+    int first = job->count - 1;
+
+    while (first >= 0 && !(job->layers[first].opaque && layer_covers(&job->layers[first], tile)))
+        first--;
+
+    if (first < 0) {
+        for (int y = 0; y < tile[3] - tile[1]; y++)
+            kernels->fill(&pixels[y * UI_RASTER_TILE_SIZE], 0, width);
+
+        first = 0;
+    }
+
+    for (int i = first; i < job->count; i++) {
+        const ui_layer_t *layer = &job->layers[i];
+        raster_texture_t *texture = texture_get(ui_window_get_texture(layer->window));
+
+        if (!texture)
+            continue;
+
+        int layer_w = layer->width < texture->width ? layer->width : texture->width;
+        int layer_h = layer->height < texture->height ? layer->height : texture->height;
+        int x0 = layer->x > tile[0] ? layer->x : tile[0];
+        int y0 = layer->y > tile[1] ? layer->y : tile[1];
+        int x1 = layer->x + layer_w < tile[2] ? layer->x + layer_w : tile[2];
+        int y1 = layer->y + layer_h < tile[3] ? layer->y + layer_h : tile[3];
+        uint32_t alpha = (uint32_t)(fminf(fmaxf(layer->opacity, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+        if (x0 >= x1 || y0 >= y1)
+            continue;
+
+        for (int y = y0; y < y1; y++) {
+            const uint32_t *src = (const uint32_t *)texture->pixels + (size_t)(y - layer->y) * texture->width + (x0 - layer->x);
+            uint32_t *dst = &pixels[(y - tile[1]) * UI_RASTER_TILE_SIZE + (x0 - tile[0])];
+
+            if (layer->opaque)
+                memcpy(dst, src, (x1 - x0) * sizeof(uint32_t));
+            else
+                kernels->blend(dst, src, alpha, NULL, x1 - x0);
+        }
+    }
+
+    for (int y = tile[1]; y < tile[3]; y++)
+        memcpy((uint8_t *)screen.pixels + (size_t)y * screen.stride + tile[0] * sizeof(uint32_t), &pixels[(y - tile[1]) * UI_RASTER_TILE_SIZE], width * sizeof(uint32_t));
+}
+
+// screen_covered is implied per tile by the opaque layer search, every tile is written either way
+void ui_raster_compose(const ui_layer_t *layers, int count, bool screen_covered) {
+    (void)screen_covered;
+
+    if (!screen.pixels)
+        return;
+
+    int tiles_x = (screen.width + UI_RASTER_TILE_SIZE - 1) / UI_RASTER_TILE_SIZE;
+    int tiles_y = (screen.height + UI_RASTER_TILE_SIZE - 1) / UI_RASTER_TILE_SIZE;
+    raster_compose_job_t job = { layers, count, tiles_x };
+
+    flux_pool_run(compose_tile, &job, tiles_x * tiles_y);
+}
@@ -0,0 +1,26 @@
+#ifndef FLUX_RASTER_H
+#define FLUX_RASTER_H
+
+#include "flux_ui.h"
+
+#define UI_RASTER_TILE_SIZE 64
+#define UI_RASTER_MAX_TEXTURE_SIZE 8192
+
+// a software backend for machines without a usable GPU: textures are premultiplied ARGB8888
+// (alpha8 for glyph atlases) in plain memory, a window's draw list is binned into tiles that
+// are filled in parallel on the worker pool, and composition writes the screen tile by tile
+// through SIMD span kernels picked for the running CPU
+int ui_raster_init();
+void ui_raster_destroy();
+void ui_raster_set_screen(uint32_t *pixels, int width, int height, int stride);
+
+GLuint ui_raster_create_texture(int width, int height, int format, const void *pixels);
+void ui_raster_update_texture(GLuint texture, int x, int y, int width, int height, int row_length, const void *pixels);
+void ui_raster_destroy_texture(GLuint texture);
+int ui_raster_create_target(window_t *window);
+void ui_raster_resize_target(window_t *window);
+void ui_raster_destroy_target(window_t *window);
+void ui_raster_draw_window(window_t *window);
+void ui_raster_compose(const ui_layer_t *layers, int count, bool screen_covered);
+
+#endif
@@ -0,0 +1,143 @@
+#include "flux_stream.h"
+#include <stdio.h>
+#include <string.h>
+
+int ui_stream_init(ui_stream_t *stream, size_t size, bool fenced) {
+    memset(stream, 0, sizeof(*stream));
+
+    stream->size = size;
+    stream->fenced = fenced;
+
+    while (glGetError() != GL_NO_ERROR);
+
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+
+    if (glGetError() != GL_NO_ERROR) {
+        printf("  EE: (flux_stream.c) ui_stream_init() -> failed to allocate %zu byte stream buffer\n", size);
+
+        glDeleteBuffers(1, &stream->buffer);
+
+        stream->buffer = 0;
+
+        return 1;
+    }
+
+    stream->limit = size;
+
+    return 0;
+}
+
+void ui_stream_destroy(ui_stream_t *stream) {
+    for (int i = 0; i < UI_STREAM_SEGMENTS; i++) {
+        if (stream->fences[i])
+            glDeleteSync(stream->fences[i]);
+    }
+
+    glDeleteBuffers(1, &stream->buffer);
+
+    memset(stream, 0, sizeof(*stream));
+}
+
+// gives the buffer fresh storage, draws still reading the old storage keep it until they finish
+static void stream_orphan(ui_stream_t *stream) {
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, stream->size, NULL, GL_STREAM_DRAW);
+
+    for (int i = 0; i < UI_STREAM_SEGMENTS && stream->fenced; i++) {
+        if (stream->fences[i]) {
+            glDeleteSync(stream->fences[i]);
+
+            stream->fences[i] = NULL;
+        }
+    }
+
+    stream->head = stream->start;
+}
+
+void ui_stream_begin_frame(ui_stream_t *stream) {
+    if (!stream->fenced) {
+        stream->start = 0;
+        stream->limit = stream->size;
+
+        stream_orphan(stream);
+
+        return;
+    }
+
+    int segment = stream->frame % UI_STREAM_SEGMENTS;
+    size_t segment_size = stream->size / UI_STREAM_SEGMENTS & ~(size_t)(UI_STREAM_ALIGN - 1);
+    GLsync fence = stream->fences[segment];
+
+    // only waits when the gpu is a full ring of frames behind
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            printf("  WW: (flux_stream.c) ui_stream_begin_frame() -> still waiting on frame %d\n", stream->frame - UI_STREAM_SEGMENTS);
+
+        glDeleteSync(fence);
+
+        stream->fences[segment] = NULL;
+    }
+
+    stream->start = segment * segment_size;
+    stream->head = stream->start;
+    stream->limit = stream->start + segment_size;
+}
+
+void ui_stream_end_frame(ui_stream_t *stream) {
+    if (stream->fenced)
+        stream->fences[stream->frame % UI_STREAM_SEGMENTS] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    stream->frame++;
+}
+
+// a frame that outgrows its region orphans the buffer and starts over in new storage
+static bool stream_reserve(ui_stream_t *stream, size_t size) {
+    if (size > stream->limit - stream->start) {
+        printf("  EE: (flux_stream.c) stream_reserve() -> %zu bytes do not fit in a frame region\n", size);
+
+        return false;
+    }
+
+    if (stream->head + size > stream->limit)
+        stream_orphan(stream);
+
+    return true;
+}
+
+static void stream_advance(ui_stream_t *stream, size_t size) {
+    stream->head += (size + UI_STREAM_ALIGN - 1) & ~(size_t)(UI_STREAM_ALIGN - 1);
+
+    if (stream->head > stream->limit)
+        stream->head = stream->limit;
+}
+
+// returns the byte offset of the copied data in the stream buffer, or -1
+long ui_stream_upload(ui_stream_t *stream, const void *data, size_t size) {
+    if (!stream->buffer || !stream_reserve(stream, size))
+        return -1;
+
+    size_t offset = stream->head;
+
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+
+    if (stream->fenced) {
+        void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+        if (!dst) {
+            printf("  EE: (flux_stream.c) ui_stream_upload() -> glMapBufferRange failed (error: 0x%x)\n", glGetError());
+
+            return -1;
+        }
+
+        memcpy(dst, data, size);
+
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    } else
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+
+    stream_advance(stream, size);
+
+    return offset;
+}
@@ -0,0 +1,33 @@
+#ifndef FLUX_STREAM_H
+#define FLUX_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
+
+#define UI_STREAM_SIZE (8 << 20)
+#define UI_STREAM_SEGMENTS 3
+#define UI_STREAM_ALIGN 16
+
+// one large vertex buffer shared by every draw of a frame; on GLES3 each frame owns a segment
+// that is written through unsynchronized maps and guarded by a fence, on GLES2 the buffer is
+// orphaned once per frame and filled front to back so no write ever waits on the gpu
+typedef struct {
+    GLuint buffer;
+    size_t size;
+    size_t head;
+    size_t start;
+    size_t limit;
+    int frame;
+    bool fenced;
+    GLsync fences[UI_STREAM_SEGMENTS];
+} ui_stream_t;
+
+int ui_stream_init(ui_stream_t *stream, size_t size, bool fenced);
+void ui_stream_destroy(ui_stream_t *stream);
+void ui_stream_begin_frame(ui_stream_t *stream);
+void ui_stream_end_frame(ui_stream_t *stream);
+long ui_stream_upload(ui_stream_t *stream, const void *data, size_t size);
+
+#endif
@@ -3,9 +3,104 @@
 #include "stb_image.h"
 #include "stb_truetype.h"
 #include "../compositor.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static unsigned int counter = 0;
 
+static PFNEGLCREATEIMAGEKHRPROC egl_create_image = NULL;
+static PFNEGLDESTROYIMAGEKHRPROC egl_destroy_image = NULL;
+static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC gl_image_target_texture = NULL;
+static PFNEGLCREATESYNCKHRPROC egl_create_sync = NULL;
+static PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync = NULL;
+static PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync = NULL;
+
+static int *pending_releases = NULL;
+static int pending_release_count = 0;
+static int pending_release_capacity = 0;
+
+static bool grow_array(widget_arena_t *arena, void **array, int *capacity, int count, size_t elem_size, int initial);
+static void window_thread_drain(window_t *window);
+
+ui_shader_t ui_shaders[UI_SHADER_VARIANTS];
+ui_stream_t ui_geometry_stream;
+const ui_backend_t *ui_backend = NULL;
+
+// GL objects for submitting draw lists, one set per thread since every render thread has its
+// own context; quads go out as four vertices on GLES2, or as one instance on GLES3 where a vao
+// holds the attribute setup and a ubo the frame size
+static _Thread_local struct {
+    ui_stream_t *stream;
+    bool ready;
+    bool instanced;
+    GLuint ibo;
+    GLuint vao;
+    GLuint corner_vbo;
+    GLuint frame_ubo;
+    int frame_width, frame_height;
+} batch;
+
+// row length and skips are core in GLES3, and ES3 drivers often leave the extension unlisted
+static bool has_unpack_subimage() {
+    static int supported = -1;
+
+    if (supported == -1) {
+        const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+
+        supported = gles_version >= 3 || (extensions && strstr(extensions, "GL_EXT_unpack_subimage") != NULL);
+    }
+
+    return supported;
+}
+
+// pixels may be NULL for storage that is rendered into before it is ever sampled
+GLuint ui_gl_create_texture(int width, int height, int format, const void *pixels) {
+    GLenum gl_format = format == UI_TEXTURE_ALPHA ? GL_ALPHA : GL_RGBA;
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, format == UI_TEXTURE_ALPHA ? 1 : 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, gl_format, width, height, 0, gl_format, GL_UNSIGNED_BYTE, pixels);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    return texture;
+}
+
+// pixels is the whole RGBA source, row_length pixels wide like the texture, and the rect sits
+// at the same place in both; without unpack_subimage the damaged rows go up at full width
+void ui_gl_update_texture(GLuint texture, int x, int y, int width, int height, int row_length, const void *pixels) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (width == row_length || !has_unpack_subimage()) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, row_length, height, GL_RGBA, GL_UNSIGNED_BYTE, (const uint8_t *)pixels + (size_t)y * row_length * 4);
+
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, row_length);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, y);
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+}
+
+void ui_gl_destroy_texture(GLuint texture) {
+    glDeleteTextures(1, &texture);
+}
+
 int ui_load_texture(window_t *window, const char *filename) {
     int width, height, channels;
     unsigned char *data = stbi_load(filename, &width, &height, &channels, 4);
@@ -16,46 +111,69 @@ int ui_load_texture(window_t *window, const char *filename) {
         return -1;
     }
 
-    GLuint tex;
+    GLuint tex = ui_backend->create_texture(width, height, UI_TEXTURE_RGBA, data);
 
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+    if (!tex) {
+        printf("  EE: (flux_ui.c) ui_load_texture() -> failed to create texture for: %s\n", filename);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        stbi_image_free(data);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return -1;
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    bool opaque = true;
+
+    for (size_t i = 3; opaque && i < (size_t)width * height * 4; i += 4)
+        opaque = data[i] == 0xff;
 
     stbi_image_free(data);
 
-    for (int i = 0; i < MAX_WIDGETS; i++) {
-        GLuint curr_tex = window->textures[i];
+    int slot = window->texture_count;
 
-        if (curr_tex == -1) {
-            window->textures[i] = tex;
-            
-            return i;
+    for (int i = 0; i < window->texture_count; i++) {
+        if (window->textures[i].id == (GLuint)-1) {
+            slot = i;
+
+            break;
         }
     }
 
-    printf("  EE: (flux_ui.c) ui_load_texture() -> maximum number of textures reached\n");
+    if (slot == window->texture_count) {
+        void *textures = window->textures;
 
-    glDeleteTextures(1, &tex);
+        if (slot == window->texture_capacity && !grow_array(&window->arena, &textures, &window->texture_capacity, slot, sizeof(texture_t), 8)) {
+            printf("  EE: (flux_ui.c) ui_load_texture() -> failed to grow texture table\n");
 
-    return -1;
+            ui_backend->destroy_texture(tex);
+
+            return -1;
+        }
+
+        window->textures = textures;
+        window->texture_count++;
+    }
+
+    window->textures[slot].id = tex;
+    window->textures[slot].opaque = opaque;
+    window->resource_count++;
+
+    return slot;
 }
 
 void ui_destroy_texture(window_t *window, int texture) {
-    if (texture != -1) {
-        GLuint tex = window->textures[texture];
+    if (texture < 0 || texture >= window->texture_count || window->textures[texture].id == (GLuint)-1)
+        return;
 
-        window->textures[texture] = -1;
+    // the window's thread may still be drawing a frame that samples it
+    if (window->thread)
+        window_thread_drain(window);
 
-        glDeleteTextures(1, &tex);
-    }
+    GLuint tex = window->textures[texture].id;
+
+    window->textures[texture].id = -1;
+    window->resource_count--;
+
+    ui_backend->destroy_texture(tex);
 }
 
 int ui_load_font(window_t *window, const char *ttf_path, float pixel_height) {
@@ -143,11 +261,17 @@ int ui_load_font(window_t *window, const char *ttf_path, float pixel_height) {
         return -1;
     }
 
-    glGenTextures(1, &font->texture);
-    glBindTexture(GL_TEXTURE_2D, font->texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_W, ATLAS_H, 0, GL_ALPHA, GL_UNSIGNED_BYTE, bitmap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    font->texture = ui_backend->create_texture(ATLAS_W, ATLAS_H, UI_TEXTURE_ALPHA, bitmap);
+
+    if (!font->texture) {
+        printf("  EE: (flux_ui.c) ui_load_font() -> failed to create glyph atlas\n");
+
+        free(bitmap);
+        free(font);
+        free(ttf_buffer);
+
+        return -1;
+    }
 
     for (int i = 32; i < 128; i++) {
         stbtt_bakedchar *b = &baked[i - 32];
@@ -169,122 +293,438 @@ int ui_load_font(window_t *window, const char *ttf_path, float pixel_height) {
 
     font->size = pixel_height;
 
-    for (int i = 0; i < MAX_WIDGETS; i++) {
+    int slot = window->font_count;
+
+    for (int i = 0; i < window->font_count; i++) {
         if (!window->fonts[i]) {
-            window->fonts[i] = font;
+            slot = i;
 
-            return i;
+            break;
         }
     }
 
-    printf("  EE: (flux_ui.c) ui_load_font() -> maximum number of fonts reached\n");
+    if (slot == window->font_count) {
+        void *fonts = window->fonts;
 
-    glDeleteTextures(1, &font->texture);
-    free(font);
-    
-    return -1;
+        if (slot == window->font_capacity && !grow_array(&window->arena, &fonts, &window->font_capacity, slot, sizeof(font_t *), 4)) {
+            printf("  EE: (flux_ui.c) ui_load_font() -> failed to grow font table\n");
+
+            ui_backend->destroy_texture(font->texture);
+            free(font);
+
+            return -1;
+        }
+
+        window->fonts = fonts;
+        window->font_count++;
+    }
+
+    window->fonts[slot] = font;
+    window->resource_count++;
+
+    return slot;
 }
 
 void ui_destroy_font(window_t *window, int font) {
-    if (font != -1) {
-        font_t *font_obj = window->fonts[font];
+    if (font < 0 || font >= window->font_count || !window->fonts[font])
+        return;
+
+    if (window->thread)
+        window_thread_drain(window);
+
+    font_t *font_obj = window->fonts[font];
+
+    window->fonts[font] = NULL;
+    window->resource_count--;
+
+    ui_backend->destroy_texture(font_obj->texture);
+    free(font_obj);
+}
+
+static bool clip_is_empty(const float clip[4]) {
+    return clip[2] <= clip[0] || clip[3] <= clip[1];
+}
+
+static void clip_intersect(const float a[4], const float b[4], float out[4]) {
+    out[0] = fmaxf(a[0], b[0]);
+    out[1] = fmaxf(a[1], b[1]);
+    out[2] = fminf(a[2], b[2]);
+    out[3] = fminf(a[3], b[3]);
+}
+
+static void instance_attrib(GLuint location, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+    glVertexAttribPointer(location, size, type, normalized, sizeof(ui_instance_t), (void *)offset);
+}
+
+// attribute locations are fixed by the GLES3 shaders, so one vao serves every variant
+static bool batch_init_instanced() {
+    static const GLubyte corners[8] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+
+    glGenVertexArrays(1, &batch.vao);
+    glGenBuffers(1, &batch.corner_vbo);
+    glGenBuffers(1, &batch.frame_ubo);
+
+    glBindVertexArray(batch.vao);
 
-        window->fonts[font] = NULL;
+    glBindBuffer(GL_ARRAY_BUFFER, batch.corner_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0, (void *)0);
 
-        glDeleteTextures(1, &font_obj->texture);
-        free(font_obj);
+    // instance pointers move with every batch's place in the stream and are set at flush time
+    for (GLuint location = 1; location <= 5; location++) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
     }
+
+    glBindVertexArray(0);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, batch.frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, 4 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UI_FRAME_BINDING, batch.frame_ubo);
+
+    batch.frame_width = batch.frame_height = -1;
+
+    return true;
 }
 
-void ui_draw_rect(float x, float y, float w, float h, float r, float red, float green, float blue, float alpha) {
-    float verts[] = {
-        0, 0,
-        1, 0,
-        0, 1,
-        1, 1,
-    };
+static bool batch_init() {
+    if (batch.ready)
+        return true;
+
+    if (!batch.stream)
+        batch.stream = &ui_geometry_stream;
+
+    batch.instanced = gles_version >= 3;
+
+    if (batch.instanced)
+        return batch.ready = batch_init_instanced();
+
+    GLushort *indices = malloc(UI_BATCH_MAX_QUADS * 6 * sizeof(GLushort));
+
+    if (!indices) {
+        printf("  EE: (flux_ui.c) batch_init() -> allocation failed for batch indices\n");
+
+        return false;
+    }
 
-    glUseProgram(program);
-    
-    glUniform1i(uni_use_texture, 0);
-    glUniform2f(uni_rect_pos, x, y);
-    glUniform2f(uni_rect_size, w, h);
-    glUniform2f(uni_screen_size, (float)mode->hdisplay, (float)mode->vdisplay);
-    glUniform4f(uni_color, red, green, blue, alpha);
-    glUniform1f(uni_radius, r);
+    for (int i = 0; i < UI_BATCH_MAX_QUADS; i++) {
+        GLushort base = i * 4;
+        GLushort *quad = &indices[i * 6];
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
+        quad[0] = base;
+        quad[1] = base + 1;
+        quad[2] = base + 2;
+        quad[3] = base + 2;
+        quad[4] = base + 1;
+        quad[5] = base + 3;
+    }
+
+    glGenBuffers(1, &batch.ibo);
 
-    glEnableVertexAttribArray(attr_pos);
-    glVertexAttribPointer(attr_pos, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, UI_BATCH_MAX_QUADS * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    free(indices);
+
+    return batch.ready = true;
 }
 
-void ui_draw_rect_texture(float x, float y, float w, float h, float r, float red, float green, float blue, float alpha, GLuint texture) {
-    float verts[] = {
-        0, 0,
-        1, 0,
-        0, 1,
-        1, 1,
-    };
+// only for threads that are about to drop their context, the main one keeps its batch for good
+static void batch_release() {
+    if (!batch.ready)
+        return;
 
-    glUseProgram(program);
-    
-    glUniform1i(uni_use_texture, 1);
-    glUniform2f(uni_rect_pos, x, y);
-    glUniform2f(uni_rect_size, w, h);
-    glUniform2f(uni_screen_size, (float)mode->hdisplay, (float)mode->vdisplay);
-    glUniform4f(uni_color, red, green, blue, alpha);
-    glUniform1f(uni_radius, r);
+    if (batch.instanced) {
+        glDeleteVertexArrays(1, &batch.vao);
+        glDeleteBuffers(1, &batch.corner_vbo);
+        glDeleteBuffers(1, &batch.frame_ubo);
+    } else
+        glDeleteBuffers(1, &batch.ibo);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    
-    glUniform1i(uni_tex, 0);
+    batch.ready = false;
+}
+
+// bytes one quad takes in a draw list, which is also its layout in the geometry stream
+static size_t quad_stride() {
+    return ui_backend->instanced ? sizeof(ui_instance_t) : 4 * sizeof(ui_vertex_t);
+}
+
+static void draw_instanced(ui_shader_t *shader, const ui_draw_cmd_t *cmd, size_t base, int width, int height) {
+    if (width != batch.frame_width || height != batch.frame_height) {
+        const float frame[4] = { width, height, 0, 0 };
+
+        glBindBuffer(GL_UNIFORM_BUFFER, batch.frame_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), frame);
+
+        batch.frame_width = width;
+        batch.frame_height = height;
+    }
+
+    glBindVertexArray(batch.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, batch.stream->buffer);
+
+    instance_attrib(1, 4, GL_FLOAT, GL_FALSE, base + offsetof(ui_instance_t, rect));
+    instance_attrib(2, 4, GL_FLOAT, GL_FALSE, base + offsetof(ui_instance_t, uv));
+    instance_attrib(3, 4, GL_FLOAT, GL_FALSE, base + offsetof(ui_instance_t, frame));
+    instance_attrib(4, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_instance_t, radius));
+    instance_attrib(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, base + offsetof(ui_instance_t, color));
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, cmd->count);
+    glBindVertexArray(0);
+}
+
+static void batch_attrib(GLint location, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+    if (location < 0)
+        return;
+
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, size, type, normalized, sizeof(ui_vertex_t), (void *)offset);
+}
+
+static void batch_disable(GLint location) {
+    if (location >= 0)
+        glDisableVertexAttribArray(location);
+}
+
+static void draw_vertices(ui_shader_t *shader, const ui_draw_cmd_t *cmd, size_t base, int width, int height) {
+    glUniform2f(shader->uni_screen_size, (float)width, (float)height);
+
+    if (cmd->variant & (UI_SHADER_TEXTURE | UI_SHADER_GLYPH))
+        glUniform1i(shader->uni_tex, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch.stream->buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ibo);
+
+    batch_attrib(shader->attr_pos, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_vertex_t, x));
+    batch_attrib(shader->attr_local, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_vertex_t, local_x));
+    batch_attrib(shader->attr_size, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_vertex_t, w));
+    batch_attrib(shader->attr_uv, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_vertex_t, u));
+    batch_attrib(shader->attr_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, base + offsetof(ui_vertex_t, color));
+    batch_attrib(shader->attr_params, 2, GL_FLOAT, GL_FALSE, base + offsetof(ui_vertex_t, radius));
+
+    glDrawElements(GL_TRIANGLES, cmd->count * 6, GL_UNSIGNED_SHORT, 0);
+
+    batch_disable(shader->attr_pos);
+    batch_disable(shader->attr_local);
+    batch_disable(shader->attr_size);
+    batch_disable(shader->attr_uv);
+    batch_disable(shader->attr_color);
+    batch_disable(shader->attr_params);
+}
+
+void ui_set_blend(bool enabled) {
+    static _Thread_local int state = -1;
+
+    if (state == enabled)
+        return;
+
+    state = enabled;
+
+    if (enabled)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+}
+
+// lets a tiled GPU skip loading the previous contents of the bound framebuffer
+void ui_discard_framebuffer(GLenum attachment) {
+    static _Thread_local PFNGLDISCARDFRAMEBUFFEREXTPROC gl_discard_framebuffer = NULL;
+    static _Thread_local int supported = -1;
+
+    if (supported == -1) {
+        const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+
+        if (extensions && strstr(extensions, "GL_EXT_discard_framebuffer"))
+            gl_discard_framebuffer = (PFNGLDISCARDFRAMEBUFFEREXTPROC)eglGetProcAddress("glDiscardFramebufferEXT");
+
+        supported = gl_discard_framebuffer != NULL;
+    }
+
+    if (!supported)
+        return;
+
+    gl_discard_framebuffer(GL_FRAMEBUFFER, 1, &attachment);
+}
+
+// runs [first, last) of a draw list; consecutive runs share one upload as long as their quads
+// fit in a single batch, every run is capped at that size when the list is built
+static void submit_draws(ui_draw_list_t *list, int first, int last, int width, int height) {
+    size_t stride = quad_stride();
+
+    if (first >= last || !batch_init())
+        return;
+
+    for (int i = first; i < last;) {
+        int start = list->cmds[i].first;
+        int end = i + 1;
+
+        while (end < last && list->cmds[end].first + list->cmds[end].count - start <= UI_BATCH_MAX_QUADS)
+            end++;
+
+        int quads = list->cmds[end - 1].first + list->cmds[end - 1].count - start;
+        long base = ui_stream_upload(batch.stream, (char *)list->quads + start * stride, quads * stride);
+
+        for (int k = i; k < end && base >= 0; k++) {
+            ui_draw_cmd_t *cmd = &list->cmds[k];
+            ui_shader_t *shader = &ui_shaders[cmd->variant];
+            size_t offset = base + (cmd->first - start) * stride;
+
+            ui_set_blend(cmd->blend);
+            glUseProgram(shader->program);
+
+            if (cmd->variant & (UI_SHADER_TEXTURE | UI_SHADER_GLYPH)) {
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, cmd->texture);
+            }
+
+            if (batch.instanced)
+                draw_instanced(shader, cmd, offset, width, height);
+            else
+                draw_vertices(shader, cmd, offset, width, height);
+        }
+
+        i = end;
+    }
+}
+
+static void draw_list_reset(ui_draw_list_t *list) {
+    list->quad_count = 0;
+    list->cmd_count = 0;
+    list->opaque_cmds = 0;
+    list->upload_count = 0;
+    list->depth = 0.0f;
+    list->depth_test = false;
+}
+
+static void draw_list_release(ui_draw_list_t *list) {
+    free(list->quads);
+    free(list->cmds);
+    free(list->uploads);
+
+    memset(list, 0, sizeof(*list));
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
+// a new shader variant, a texture change, a full run or the first translucent quad after
+// opaque ones starts a new run, which stays unblended until it meets translucent content;
+// runs of the pre-pass are never extended by the pass after it
+static void *draw_list_push_quad(ui_draw_list_t *list, int variant, GLuint texture, bool blend) {
+    ui_draw_cmd_t *cmd = list->cmd_count > list->opaque_cmds ? &list->cmds[list->cmd_count - 1] : NULL;
+    size_t stride = quad_stride();
 
-    glEnableVertexAttribArray(attr_pos);
-    glVertexAttribPointer(attr_pos, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    if (!cmd || cmd->variant != variant || cmd->texture != texture || cmd->count == UI_BATCH_MAX_QUADS || (blend && !cmd->blend)) {
+        if (list->cmd_count == list->cmd_capacity && !grow_array(NULL, (void **)&list->cmds, &list->cmd_capacity, list->cmd_count, sizeof(ui_draw_cmd_t), 16)) {
+            printf("  EE: (flux_ui.c) draw_list_push_quad() -> allocation failed for draw runs\n");
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            return NULL;
+        }
+
+        cmd = &list->cmds[list->cmd_count++];
+        cmd->first = list->quad_count;
+        cmd->count = 0;
+        cmd->variant = variant;
+        cmd->texture = texture;
+        cmd->blend = blend;
+    }
+
+    if (list->quad_count == list->quad_capacity && !grow_array(NULL, &list->quads, &list->quad_capacity, list->quad_count, stride, UI_DRAW_LIST_MIN_QUADS)) {
+        printf("  EE: (flux_ui.c) draw_list_push_quad() -> allocation failed for draw list quads\n");
+
+        return NULL;
+    }
+
+    cmd->count++;
+
+    return (char *)list->quads + (size_t)list->quad_count++ * stride;
 }
 
-static void draw_glyph(float x, float y, float w, float h, float u0, float v0, float u1, float v1, float red, float green, float blue, float alpha, GLuint font_texture){
-    float verts[] = {
-        0, 0, u0, v0,
-        1, 0, u1, v0,
-        0, 1, u0, v1,
-        1, 1, u1, v1
+// appends one quad cut to its clip rect, so no shader variant needs a per-fragment clip test
+static void batch_quad(ui_draw_list_t *list, const float rect[4], const float uv[4], float radius, int variant, const float color[4], const float clip[4], GLuint texture, bool opaque) {
+    const float visible[4] = {
+        fmaxf(rect[0], clip[0]), fmaxf(rect[1], clip[1]),
+        fminf(rect[0] + rect[2], clip[2]), fminf(rect[1] + rect[3], clip[3]),
     };
 
-    glUseProgram(text_program);
+    if (clip_is_empty(visible) || rect[2] <= 0 || rect[3] <= 0)
+        return;
+
+    if (radius > 0)
+        variant |= UI_SHADER_ROUNDED;
+
+    bool textured = variant & (UI_SHADER_TEXTURE | UI_SHADER_GLYPH);
+    void *quad = draw_list_push_quad(list, variant, textured ? texture : 0, !opaque);
+
+    if (!quad)
+        return;
+
+    GLubyte packed[4];
+
+    for (int i = 0; i < 4; i++)
+        packed[i] = (GLubyte)(fminf(fmaxf(color[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+
+    if (ui_backend->instanced) {
+        ui_instance_t *instance = quad;
+        float du = (uv[2] - uv[0]) / rect[2];
+        float dv = (uv[3] - uv[1]) / rect[3];
+
+        instance->rect[0] = visible[0];
+        instance->rect[1] = visible[1];
+        instance->rect[2] = visible[2];
+        instance->rect[3] = visible[3];
+        instance->uv[0] = uv[0] + (visible[0] - rect[0]) * du;
+        instance->uv[1] = uv[1] + (visible[1] - rect[1]) * dv;
+        instance->uv[2] = uv[0] + (visible[2] - rect[0]) * du;
+        instance->uv[3] = uv[1] + (visible[3] - rect[1]) * dv;
+        instance->frame[0] = rect[0];
+        instance->frame[1] = rect[1];
+        instance->frame[2] = rect[2];
+        instance->frame[3] = rect[3];
+        instance->radius = radius;
+        instance->depth = list->depth;
+
+        memcpy(instance->color, packed, sizeof(packed));
 
-    glUniform2f(text_uni_glyph_pos, x, y);
-    glUniform2f(text_uni_glyph_size, w, h);
-    glUniform2f(text_uni_screen_size, mode->hdisplay, mode->vdisplay);
-    glUniform4f(text_uni_color, red, green, blue, alpha);
+        return;
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, font_texture);
-    glUniform1i(text_uni_tex, 0);
+    ui_vertex_t *v = quad;
+
+    for (int i = 0; i < 4; i++) {
+        float x = (i & 1) ? visible[2] : visible[0];
+        float y = (i & 2) ? visible[3] : visible[1];
+        float tx = (x - rect[0]) / rect[2];
+        float ty = (y - rect[1]) / rect[3];
+
+        v[i].x = x;
+        v[i].y = y;
+        v[i].local_x = x - rect[0];
+        v[i].local_y = y - rect[1];
+        v[i].w = rect[2];
+        v[i].h = rect[3];
+        v[i].u = uv[0] + (uv[2] - uv[0]) * tx;
+        v[i].v = uv[1] + (uv[3] - uv[1]) * ty;
+        v[i].radius = radius;
+        v[i].depth = list->depth;
+
+        memcpy(v[i].color, packed, sizeof(packed));
+    }
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
+void ui_draw_rect(ui_draw_list_t *list, float x, float y, float w, float h, float r, const float color[4], const float clip[4]) {
+    const float rect[4] = { x, y, w, h };
+    const float uv[4] = { 0, 0, 1, 1 };
 
-    glEnableVertexAttribArray(text_attr_pos);
-    glEnableVertexAttribArray(text_attr_uv);
+    batch_quad(list, rect, uv, r, 0, color, clip, 0, color[3] >= 1.0f && r <= 0);
+}
 
-    glVertexAttribPointer(text_attr_pos, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    glVertexAttribPointer(text_attr_uv, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+void ui_draw_rect_texture(ui_draw_list_t *list, float x, float y, float w, float h, float r, const float color[4], const float clip[4], GLuint texture, bool opaque_texture) {
+    const float rect[4] = { x, y, w, h };
+    const float uv[4] = { 0, 0, 1, 1 };
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    batch_quad(list, rect, uv, r, UI_SHADER_TEXTURE, color, clip, texture, opaque_texture && color[3] >= 1.0f && r <= 0);
 }
 
-void ui_draw_text(float x, float y, font_t *font, const char *text, float r, float g, float b, float a) {
+void ui_draw_text(ui_draw_list_t *list, float x, float y, font_t *font, const char *text, const float color[4], const float clip[4]) {
     float pen_x = x;
     float pen_y = y;
 
@@ -300,13 +740,13 @@ void ui_draw_text(float x, float y, font_t *font, const char *text, float r, flo
 
         if (c < 32 || c >= 128)
             continue;
-        
+
         glyph_t *glyph = &font->glyphs[(int)c];
 
-        float gx = pen_x + glyph->xoff;
-        float gy = pen_y + glyph->yoff;
+        const float rect[4] = { pen_x + glyph->xoff, pen_y + glyph->yoff, glyph->w, glyph->h };
+        const float uv[4] = { glyph->u0, glyph->v0, glyph->u1, glyph->v1 };
 
-        draw_glyph(gx, gy, glyph->w, glyph->h, glyph->u0, glyph->v0, glyph->u1, glyph->v1, r, g, b, a, font->texture);
+        batch_quad(list, rect, uv, 0, UI_SHADER_GLYPH, color, clip, font->texture, false);
 
         pen_x += glyph->xadvance;
     }
@@ -318,6 +758,12 @@ void ui_measure_text(window_t *window, const char *text, int font, float *out_wi
     float visual_min_y = 1e6f;
     float visual_max_y = -1e6f;
 
+    if (font < 0 || font >= window->font_count || !window->fonts[font]) {
+        printf("  WW: (flux_ui.c) ui_measure_text() -> invalid font index %d\n", font);
+
+        return;
+    }
+
     font_t *real_font = window->fonts[font];
 
     while (*text) {
@@ -364,138 +810,1376 @@ void ui_measure_text(window_t *window, const char *text, int font, float *out_wi
         *out_visual_min_y = visual_min_y;
 }
 
-window_t *ui_create_window() {
-    int width = mode->hdisplay;
-    int height = mode->vdisplay;
+#define ARENA_HEADER_SIZE ((sizeof(arena_block_t) + 15) & ~(size_t)15)
+#define ARENA_LARGE_HEADER_SIZE ((sizeof(arena_large_t) + 15) & ~(size_t)15)
 
-    window_t *window = calloc(1, sizeof(window_t));
-    window->widget_count = 0;
-    window->has_focus = false;
-    window->rendered = true;
-    window->width = width;
-    window->height = height;
-    window->id = counter++;
+static int arena_size_class(size_t size) {
+    size_t class_size = ARENA_MIN_CLASS;
 
-    memset(window->textures, -1, sizeof(window->textures));
+    for (int i = 0; i < ARENA_SIZE_CLASSES; i++, class_size <<= 1) {
+        if (size <= class_size)
+            return i;
+    }
 
-    glGenTextures(1, &window->color_tex);
-    glBindTexture(GL_TEXTURE_2D, window->color_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    return -1;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+static void *arena_bump(arena_block_t **blocks, size_t size) {
+    arena_block_t *block = *blocks;
 
-    glGenFramebuffers(1, &window->fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+    if (!block || block->used + size > block->size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, window->color_tex, 0);
+        block = malloc(ARENA_HEADER_SIZE + block_size);
 
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (!block) {
+            printf("  EE: (flux_ui.c) arena_bump() -> malloc failed for arena block\n");
 
-    if (status != GL_FRAMEBUFFER_COMPLETE) {
-        printf("  EE: (flux_ui.c) ui_create_window() -> window framebuffer incomplete (0x%x)\n", status);
+            return NULL;
+        }
 
-        exit(1);
+        block->next = *blocks;
+        block->size = block_size;
+        block->used = 0;
+
+        *blocks = block;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    void *ptr = (unsigned char *)block + ARENA_HEADER_SIZE + block->used;
 
-    return window;
+    block->used += size;
+
+    return ptr;
 }
 
-static void widget_get_world_pos(widget_t *widget, float *x, float *y) {
-    float pos_x = widget->x;
-    float pos_y = widget->y;
+static void *arena_alloc(widget_arena_t *arena, size_t size) {
+    int size_class = arena_size_class(size);
+
+    if (size_class < 0) {
+        arena_large_t *large = malloc(ARENA_LARGE_HEADER_SIZE + size);
+
+        if (!large) {
+            printf("  EE: (flux_ui.c) arena_alloc() -> malloc failed for %zu bytes\n", size);
+
+            return NULL;
+        }
+
+        large->prev = NULL;
+        large->next = arena->large;
+
+        if (arena->large)
+            arena->large->prev = large;
+
+        arena->large = large;
+
+        return (unsigned char *)large + ARENA_LARGE_HEADER_SIZE;
+    }
+
+    void *ptr = arena->free_lists[size_class];
 
-    while (widget->parent.type == PARENT_WIDGET) {
-        widget = widget->parent.widget;
-        pos_x += widget->x;
-        pos_y += widget->y;
+    if (ptr) {
+        arena->free_lists[size_class] = *(void **)ptr;
+
+        return ptr;
     }
 
-    *x = pos_x;
-    *y = pos_y;
+    return arena_bump(&arena->blocks, (size_t)ARENA_MIN_CLASS << size_class);
 }
 
-static void render_widget(widget_t *widget) {
-    float r, g, b, a;
-    float pos_x, pos_y;
+static void arena_free(widget_arena_t *arena, void *ptr, size_t size) {
+    if (!ptr)
+        return;
 
-    widget_get_world_pos(widget, &pos_x, &pos_y);
+    int size_class = arena_size_class(size);
 
-    if (strlen(widget->color) != 0)
-        ui_hex_to_rgba(widget->color, &r, &g, &b, &a);
+    if (size_class < 0) {
+        arena_large_t *large = (arena_large_t *)((unsigned char *)ptr - ARENA_LARGE_HEADER_SIZE);
 
-    if (widget->parent.type == PARENT_WIDGET) {
-        int x, y, w, h;
-        widget_t *parent = widget->parent.widget;
+        if (large->prev)
+            large->prev->next = large->next;
+        else
+            arena->large = large->next;
 
-        x = (int)parent->x;
-        y = (int)parent->y;
-        w = (int)parent->w;
-        h = (int)parent->h;
+        if (large->next)
+            large->next->prev = large->prev;
 
-        y = mode->vdisplay - (y + h);
+        free(large);
 
-        glEnable(GL_SCISSOR_TEST);
-        glScissor(x, y, w, h);
+        return;
     }
 
-    switch (widget->type) {
-        case WIDGET_RECT: {
-            ui_draw_rect(pos_x, pos_y, widget->w, widget->h, widget->radius, r, g, b, a);
+    *(void **)ptr = arena->free_lists[size_class];
+    arena->free_lists[size_class] = ptr;
+}
 
-            break;
-        }
+static widget_t *arena_alloc_widget(widget_arena_t *arena) {
+    widget_t *widget = arena->free_widgets;
 
-        case WIDGET_TEXT: {
-            ui_draw_text(pos_x, pos_y, widget->font, widget->text, r, g, b, a);
+    if (widget)
+        arena->free_widgets = *(widget_t **)widget;
+    else {
+        arena_block_t *block = arena->widget_blocks;
 
-            break;
-        }
+        if (!block || block->used + sizeof(widget_t) > block->size) {
+            block = malloc(ARENA_HEADER_SIZE + sizeof(widget_t) * ARENA_WIDGETS_PER_BLOCK);
 
-        case WIDGET_IMAGE: {
-            ui_draw_rect_texture(pos_x, pos_y, widget->w, widget->h, widget->radius, r, g, b, a, widget->texture);
+            if (!block) {
+                printf("  EE: (flux_ui.c) arena_alloc_widget() -> malloc failed for widget block\n");
 
-            break;
+                return NULL;
+            }
+
+            block->next = arena->widget_blocks;
+            block->size = sizeof(widget_t) * ARENA_WIDGETS_PER_BLOCK;
+            block->used = 0;
+
+            arena->widget_blocks = block;
         }
 
-        case WIDGET_NONE:
-            break;
+        widget = (widget_t *)((unsigned char *)block + ARENA_HEADER_SIZE + block->used);
+        block->used += sizeof(widget_t);
     }
 
-    glDisable(GL_SCISSOR_TEST);
+    memset(widget, 0, sizeof(widget_t));
 
-    for (int i = 0; i < widget->child_count; i++)
-        render_widget(widget->children[i]);
+    return widget;
 }
 
-void ui_render_window(window_t *window) {
-    if (!window || window->widget_count <= 0 || !window->rendered)
-        return;
+static void arena_free_widget(widget_arena_t *arena, widget_t *widget) {
+    *(widget_t **)widget = arena->free_widgets;
+    arena->free_widgets = widget;
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
-    glViewport(0, 0, window->width, window->height);
+static void arena_release_blocks(arena_block_t *block) {
+    while (block) {
+        arena_block_t *next = block->next;
 
-    glClearColor(0, 0, 0, 0);
-    glClear(GL_COLOR_BUFFER_BIT);
+        free(block);
 
-    for (int i = 0; i < window->widget_count; i++)
-        render_widget(window->widgets[i]);
+        block = next;
+    }
 }
 
-void ui_destroy_window(window_t *window) {
-    for (int i = 0; i < window->widget_count; i++)
-        ui_destroy_widget(window->widgets[i]);
+static void arena_release(widget_arena_t *arena) {
+    arena_release_blocks(arena->blocks);
+    arena_release_blocks(arena->widget_blocks);
 
-    memset(window->widgets, 0, sizeof(window->widgets));
+    while (arena->large) {
+        arena_large_t *next = arena->large->next;
 
-    window->widget_count = 0;
-    window->has_focus = false;
+        free(arena->large);
 
+        arena->large = next;
+    }
+
+    memset(arena, 0, sizeof(*arena));
+}
+
+static void *widget_alloc(widget_t *widget, size_t size) {
+    return widget->arena ? arena_alloc(widget->arena, size) : malloc(size);
+}
+
+static void widget_free(widget_t *widget, void *ptr, size_t size) {
+    if (widget->arena)
+        arena_free(widget->arena, ptr, size);
+    else
+        free(ptr);
+}
+
+// doubles an arena (or heap, without an arena) array so it can take at least one more element
+static bool grow_array(widget_arena_t *arena, void **array, int *capacity, int count, size_t elem_size, int initial) {
+    int new_capacity = *capacity ? *capacity * 2 : initial;
+
+    if (new_capacity <= *capacity)
+        return false;
+
+    size_t bytes = (size_t)new_capacity * elem_size;
+    void *grown = arena ? arena_alloc(arena, bytes) : malloc(bytes);
+
+    if (!grown)
+        return false;
+
+    if (*array)
+        memcpy(grown, *array, (size_t)count * elem_size);
+
+    if (arena)
+        arena_free(arena, *array, (size_t)*capacity * elem_size);
+    else
+        free(*array);
+
+    *array = grown;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+void *ui_window_alloc(window_t *window, size_t size) {
+    return arena_alloc(&window->arena, size);
+}
+
+void ui_window_free(window_t *window, void *ptr, size_t size) {
+    arena_free(&window->arena, ptr, size);
+}
+
+static uint32_t hash_widget_id(const char *id) {
+    uint32_t hash = 2166136261u;
+
+    while (*id) {
+        hash ^= (unsigned char)*id++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static widget_t index_tombstone;
+
+static widget_t *widget_index_find(widget_index_t *index, const char *id, uint32_t hash) {
+    if (index->capacity == 0)
+        return NULL;
+
+    uint32_t mask = index->capacity - 1;
+
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        widget_t *curr_widg = index->slots[i];
+
+        if (!curr_widg)
+            return NULL;
+
+        if (curr_widg != &index_tombstone && curr_widg->id_hash == hash && strcmp(curr_widg->id, id) == 0)
+            return curr_widg;
+    }
+}
+
+static void widget_index_destroy(widget_index_t *index) {
+    if (index->arena)
+        arena_free(index->arena, index->slots, index->capacity * sizeof(widget_t *));
+    else
+        free(index->slots);
+
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->tombstones = 0;
+}
+
+static bool widget_index_resize(widget_index_t *index, uint32_t capacity) {
+    size_t bytes = capacity * sizeof(widget_t *);
+    widget_t **slots = index->arena ? arena_alloc(index->arena, bytes) : malloc(bytes);
+
+    if (!slots) {
+        printf("  EE: (flux_ui.c) widget_index_resize() -> allocation failed for %u slots\n", capacity);
+
+        return false;
+    }
+
+    memset(slots, 0, bytes);
+
+    for (uint32_t i = 0; i < index->capacity; i++) {
+        widget_t *curr_widg = index->slots[i];
+
+        if (!curr_widg || curr_widg == &index_tombstone)
+            continue;
+
+        uint32_t slot = curr_widg->id_hash & (capacity - 1);
+
+        while (slots[slot])
+            slot = (slot + 1) & (capacity - 1);
+
+        slots[slot] = curr_widg;
+    }
+
+    uint32_t count = index->count;
+
+    widget_index_destroy(index);
+
+    index->slots = slots;
+    index->capacity = capacity;
+    index->count = count;
+
+    return true;
+}
+
+// the caller has already checked that no widget with the same id is indexed
+static bool widget_index_insert(widget_index_t *index, widget_t *widget) {
+    if ((index->count + index->tombstones + 1) * 4 > index->capacity * 3) {
+        uint32_t capacity = index->capacity ? index->capacity : 16;
+
+        while ((index->count + 1) * 2 > capacity)
+            capacity *= 2;
+
+        if (!widget_index_resize(index, capacity))
+            return false;
+    }
+
+    uint32_t mask = index->capacity - 1;
+    uint32_t i = widget->id_hash & mask;
+
+    while (index->slots[i] && index->slots[i] != &index_tombstone)
+        i = (i + 1) & mask;
+
+    if (index->slots[i] == &index_tombstone)
+        index->tombstones--;
+
+    index->slots[i] = widget;
+    index->count++;
+
+    return true;
+}
+
+static void widget_index_remove(widget_index_t *index, widget_t *widget) {
+    if (index->capacity == 0)
+        return;
+
+    uint32_t mask = index->capacity - 1;
+
+    for (uint32_t i = widget->id_hash & mask; index->slots[i]; i = (i + 1) & mask) {
+        if (index->slots[i] == widget) {
+            index->slots[i] = &index_tombstone;
+            index->count--;
+            index->tombstones++;
+
+            return;
+        }
+    }
+}
+
+static void widget_index_replace(widget_index_t *index, widget_t *old_widget, widget_t *widget) {
+    uint32_t mask = index->capacity - 1;
+
+    for (uint32_t i = old_widget->id_hash & mask; index->slots[i]; i = (i + 1) & mask) {
+        if (index->slots[i] == old_widget) {
+            index->slots[i] = widget;
+
+            return;
+        }
+    }
+}
+
+static uint32_t window_acquire_handle(window_t *window, widget_t *widget) {
+    uint32_t slot_index;
+
+    if (window->free_handle) {
+        slot_index = window->free_handle - 1;
+        window->free_handle = window->handles[slot_index].next_free;
+    } else {
+        if (window->handle_count >= WIDGET_HANDLE_INDEX_MASK) {
+            printf("  WW: (flux_ui.c) window_acquire_handle() -> widget handle space exhausted\n");
+
+            return 0;
+        }
+
+        if (window->handle_count == window->handle_capacity) {
+            uint32_t capacity = window->handle_capacity ? window->handle_capacity * 2 : 64;
+            widget_handle_slot_t *grown = realloc(window->handles, capacity * sizeof(widget_handle_slot_t));
+
+            if (!grown) {
+                printf("  EE: (flux_ui.c) window_acquire_handle() -> realloc failed for handle table\n");
+
+                return 0;
+            }
+
+            window->handles = grown;
+            window->handle_capacity = capacity;
+        }
+
+        slot_index = window->handle_count++;
+        window->handles[slot_index].generation = 1;
+    }
+
+    widget_handle_slot_t *slot = &window->handles[slot_index];
+
+    slot->widget = widget;
+    slot->next_free = 0;
+
+    return (slot->generation << WIDGET_HANDLE_INDEX_BITS) | (slot_index + 1);
+}
+
+static void window_release_handle(window_t *window, uint32_t handle) {
+    uint32_t slot_index = (handle & WIDGET_HANDLE_INDEX_MASK) - 1;
+
+    if (handle == 0 || slot_index >= window->handle_count)
+        return;
+
+    widget_handle_slot_t *slot = &window->handles[slot_index];
+
+    slot->widget = NULL;
+    slot->generation = (slot->generation + 1) & WIDGET_HANDLE_GENERATION_MASK;
+
+    if (slot->generation == 0)
+        slot->generation = 1;
+
+    slot->next_free = window->free_handle;
+    window->free_handle = slot_index + 1;
+}
+
+static int window_acquire_render(window_t *window, widget_t *widget) {
+    int index;
+
+    if (window->free_render) {
+        index = window->free_render - 1;
+        window->free_render = window->render[index].parent;
+    } else {
+        if (window->render_count == window->render_capacity) {
+            int capacity = window->render_capacity ? window->render_capacity * 2 : 64;
+            widget_render_t *render = realloc(window->render, capacity * sizeof(widget_render_t));
+
+            if (!render) {
+                printf("  EE: (flux_ui.c) window_acquire_render() -> realloc failed for render data\n");
+
+                return -1;
+            }
+
+            window->render = render;
+
+            widget_t **render_widgets = realloc(window->render_widgets, capacity * sizeof(widget_t *));
+
+            if (!render_widgets) {
+                printf("  EE: (flux_ui.c) window_acquire_render() -> realloc failed for render owners\n");
+
+                return -1;
+            }
+
+            window->render_widgets = render_widgets;
+
+            widget_world_t *world = realloc(window->world, capacity * sizeof(widget_world_t));
+
+            if (!world) {
+                printf("  EE: (flux_ui.c) window_acquire_render() -> realloc failed for world transforms\n");
+
+                return -1;
+            }
+
+            window->world = world;
+            window->render_capacity = capacity;
+        }
+
+        index = window->render_count++;
+    }
+
+    window->render_widgets[index] = widget;
+    window->world[index].pass = 0;
+
+    return index;
+}
+
+// a free record reuses its parent field as the next link of the free list
+static void window_release_render(window_t *window, int index) {
+    if (index < 0 || index >= window->render_count)
+        return;
+
+    widget_render_t *data = &window->render[index];
+
+    memset(data, 0, sizeof(*data));
+
+    data->parent = window->free_render;
+    window->render_widgets[index] = NULL;
+    window->free_render = index + 1;
+    window->draw_order_dirty = true;
+}
+
+static widget_render_t *widget_render(widget_t *widget) {
+    return &widget->window->render[widget->render_index];
+}
+
+static bool push_draw_order(window_t *window, widget_t *widget) {
+    if (window->draw_count == window->draw_capacity) {
+        int capacity = window->draw_capacity ? window->draw_capacity * 2 : 64;
+        widget_draw_t *grown = realloc(window->draw_order, capacity * sizeof(widget_draw_t));
+
+        if (!grown)
+            return false;
+
+        window->draw_order = grown;
+        window->draw_capacity = capacity;
+    }
+
+    int position = window->draw_count++;
+
+    window->draw_order[position].render = widget->render_index;
+
+    for (int i = 0; i < widget->child_count; i++) {
+        if (!push_draw_order(window, widget->children[i]))
+            return false;
+    }
+
+    window->draw_order[position].end = window->draw_count;
+
+    return true;
+}
+
+// flattens the widget tree into parent-before-child order, only when its shape changed
+static void build_draw_order(window_t *window) {
+    window->draw_count = 0;
+
+    for (int i = 0; i < window->widget_count; i++) {
+        if (!push_draw_order(window, window->widgets[i])) {
+            printf("  EE: (flux_ui.c) build_draw_order() -> realloc failed for draw order\n");
+
+            window->draw_count = 0;
+
+            return;
+        }
+    }
+
+    window->draw_order_dirty = false;
+}
+
+int ui_gl_create_target(window_t *window) {
+    window->color_tex = ui_gl_create_texture(window->width, window->height, UI_TEXTURE_RGBA, NULL);
+
+    glGenFramebuffers(1, &window->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, window->color_tex, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("  EE: (flux_ui.c) ui_gl_create_target() -> window framebuffer incomplete (0x%x)\n", status);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+window_t *ui_create_window() {
+    int width = mode->hdisplay;
+    int height = mode->vdisplay;
+
+    window_t *window = calloc(1, sizeof(window_t));
+    window->widget_count = 0;
+    window->has_focus = false;
+    window->rendered = true;
+    window->width = width;
+    window->height = height;
+    window->opacity = 1.0f;
+    window->id = counter++;
+    window->widget_index.arena = &window->arena;
+
+    if (ui_backend->create_target(window) != 0) {
+        printf("  EE: (flux_ui.c) ui_create_window() -> failed to create the window's render target\n");
+
+        exit(1);
+    }
+
+    return window;
+}
+
+// draw order lists parents first, so each widget inherits an already final parent transform
+// and clip; only widgets that moved, or whose parent was recomputed in this pass, do any work
+static void update_world_transforms(window_t *window) {
+    uint32_t pass = ++window->world_pass;
+
+    if (pass == 0)
+        pass = window->world_pass = 1;
+
+    for (int i = 0; i < window->draw_count; i++) {
+        int index = window->draw_order[i].render;
+        widget_render_t *data = &window->render[index];
+        widget_world_t *world = &window->world[index];
+        widget_world_t *parent_world = data->parent >= 0 ? &window->world[data->parent] : NULL;
+
+        if (!(data->flags & WIDGET_RENDER_MOVED) && world->pass != 0 && (!parent_world || parent_world->pass != pass))
+            continue;
+
+        data->flags &= ~WIDGET_RENDER_MOVED;
+        world->pass = pass;
+
+        if (!parent_world) {
+            world->x = data->x;
+            world->y = data->y;
+            world->clip[0] = 0;
+            world->clip[1] = 0;
+            world->clip[2] = window->width;
+            world->clip[3] = window->height;
+
+            continue;
+        }
+
+        widget_render_t *parent = &window->render[data->parent];
+        const float parent_rect[4] = { parent_world->x, parent_world->y, parent_world->x + parent->w, parent_world->y + parent->h };
+
+        world->x = parent_world->x + data->x;
+        world->y = parent_world->y + data->y;
+
+        clip_intersect(parent_world->clip, parent_rect, world->clip);
+    }
+}
+
+static void upload_buffer_damage(widget_t *widget, GLuint texture) {
+    client_buffer_t *buffer = widget->buffer;
+
+    if (buffer->damage_x1 <= buffer->damage_x0 || buffer->damage_y1 <= buffer->damage_y0)
+        return;
+
+    int x = buffer->damage_x0;
+    int y = buffer->damage_y0;
+    int w = buffer->damage_x1 - buffer->damage_x0;
+    int h = buffer->damage_y1 - buffer->damage_y0;
+
+    ui_backend->update_texture(texture, x, y, w, h, buffer->width, buffer->pixels);
+
+    buffer->damage_x0 = buffer->damage_y0 = 0;
+    buffer->damage_x1 = buffer->damage_y1 = 0;
+}
+
+// texture uploads are GL work, so building only notes which drawn widgets need one
+static void queue_widget_upload(window_t *window, int index) {
+    ui_draw_list_t *list = &window->draw_list;
+
+    if (!(window->render[index].flags & WIDGET_RENDER_DAMAGED))
+        return;
+
+    if (list->upload_count == list->upload_capacity && !grow_array(NULL, (void **)&list->uploads, &list->upload_capacity, list->upload_count, sizeof(int), 8)) {
+        printf("  EE: (flux_ui.c) queue_widget_upload() -> allocation failed for upload list\n");
+
+        return;
+    }
+
+    list->uploads[list->upload_count++] = index;
+}
+
+static void refresh_widget_textures(window_t *window) {
+    ui_draw_list_t *list = &window->draw_list;
+
+    for (int i = 0; i < list->upload_count; i++) {
+        widget_render_t *data = &window->render[list->uploads[i]];
+
+        if (data->flags & WIDGET_RENDER_DAMAGED) {
+            upload_buffer_damage(window->render_widgets[list->uploads[i]], data->texture);
+
+            data->flags &= ~WIDGET_RENDER_DAMAGED;
+        }
+    }
+
+    list->upload_count = 0;
+}
+
+static void build_widget(window_t *window, int index) {
+    ui_draw_list_t *list = &window->draw_list;
+    widget_render_t *data = &window->render[index];
+    widget_world_t *world = &window->world[index];
+
+    queue_widget_upload(window, index);
+
+    switch ((widget_type_t)data->type) {
+        case WIDGET_RECT: {
+            ui_draw_rect(list, world->x, world->y, data->w, data->h, data->radius, data->color, world->clip);
+
+            break;
+        }
+
+        case WIDGET_TEXT: {
+            if (data->font)
+                ui_draw_text(list, world->x, world->y, data->font, data->text, data->color, world->clip);
+
+            break;
+        }
+
+        case WIDGET_IMAGE:
+        case WIDGET_BUFFER: {
+            ui_draw_rect_texture(list, world->x, world->y, data->w, data->h, data->radius, data->color, world->clip, data->texture, data->flags & WIDGET_RENDER_OPAQUE_CONTENT);
+
+            break;
+        }
+
+        case WIDGET_NONE:
+            break;
+    }
+}
+
+static bool widget_is_opaque(const widget_render_t *data) {
+    if (!(data->flags & WIDGET_RENDER_READY) || data->color[3] < 1.0f || data->radius > 0)
+        return false;
+
+    if (data->type == WIDGET_RECT)
+        return true;
+
+    return (data->type == WIDGET_IMAGE || data->type == WIDGET_BUFFER) && (data->flags & WIDGET_RENDER_OPAQUE_CONTENT);
+}
+
+static bool rect_contains(const float outer[4], const float inner[4]) {
+    return inner[0] >= outer[0] && inner[1] >= outer[1] && inner[2] <= outer[2] && inner[3] <= outer[3];
+}
+
+// walks the draw order back to front keeping the largest opaque rects seen so far; anything
+// drawn earlier that falls entirely inside one of them can never reach the framebuffer
+static void update_occlusion(window_t *window) {
+    float occluders[UI_MAX_OCCLUDERS][4];
+    int occluder_count = 0;
+    const float window_rect[4] = { 0, 0, window->width, window->height };
+
+    window->opaque = false;
+
+    for (int i = window->draw_count - 1; i >= 0; i--) {
+        int index = window->draw_order[i].render;
+        widget_render_t *data = &window->render[index];
+        widget_world_t *world = &window->world[index];
+        float visible[4];
+
+        data->flags &= ~WIDGET_RENDER_HIDDEN;
+
+        if (!(data->flags & WIDGET_RENDER_READY) || clip_is_empty(world->clip))
+            continue;
+
+        // text has no fixed extent, so the clip is the only safe bound for it
+        if (data->type == WIDGET_TEXT || data->w <= 0 || data->h <= 0) {
+            memcpy(visible, world->clip, sizeof(visible));
+        } else {
+            const float rect[4] = { world->x, world->y, world->x + data->w, world->y + data->h };
+
+            clip_intersect(world->clip, rect, visible);
+        }
+
+        if (clip_is_empty(visible))
+            continue;
+
+        const float outer[4] = { floorf(visible[0]), floorf(visible[1]), ceilf(visible[2]), ceilf(visible[3]) };
+        bool hidden = false;
+
+        for (int k = 0; k < occluder_count && !hidden; k++)
+            hidden = rect_contains(occluders[k], outer);
+
+        if (hidden) {
+            data->flags |= WIDGET_RENDER_HIDDEN;
+
+            continue;
+        }
+
+        if (!widget_is_opaque(data))
+            continue;
+
+        // only whole pixels count, partially covered edge pixels are blended with what is below
+        float inner[4] = { ceilf(visible[0]), ceilf(visible[1]), floorf(visible[2]), floorf(visible[3]) };
+        float area = (inner[2] - inner[0]) * (inner[3] - inner[1]);
+
+        if (clip_is_empty(inner))
+            continue;
+
+        if (rect_contains(inner, window_rect))
+            window->opaque = true;
+
+        int slot = occluder_count;
+
+        if (occluder_count == UI_MAX_OCCLUDERS) {
+            slot = -1;
+
+            for (int k = 0; k < UI_MAX_OCCLUDERS; k++) {
+                float *o = occluders[k];
+
+                if ((o[2] - o[0]) * (o[3] - o[1]) < area) {
+                    area = (o[2] - o[0]) * (o[3] - o[1]);
+                    slot = k;
+                }
+            }
+
+            if (slot < 0)
+                continue;
+        } else
+            occluder_count++;
+
+        memcpy(occluders[slot], inner, sizeof(inner));
+    }
+}
+
+void ui_prepare_window(window_t *window) {
+    if (!window || !window->rendered)
+        return;
+
+    if (window->draw_order_dirty)
+        build_draw_order(window);
+
+    update_world_transforms(window);
+    update_occlusion(window);
+
+    window->prepared = true;
+}
+
+// later widgets are nearer, every draw gets its own step of the 16-bit depth range
+static float draw_depth(int draw, int draw_count) {
+    return 1.0f - 2.0f * (draw + 1) / (draw_count + 1);
+}
+
+static bool attach_depth_buffer(window_t *window) {
+    if (window->depth_rbo)
+        return true;
+
+    glGenRenderbuffers(1, &window->depth_rbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, window->depth_rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, window->width, window->height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, window->depth_rbo);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("  WW: (flux_ui.c) attach_depth_buffer() -> depth attachment unsupported, depth pre-pass disabled\n");
+
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+        glDeleteRenderbuffers(1, &window->depth_rbo);
+
+        window->depth_rbo = 0;
+        window->depth_prepass = false;
+
+        return false;
+    }
+
+    return true;
+}
+
+// opaque widgets go front to back with depth writes, so early depth testing rejects every
+// fragment that an opaque widget nearer the viewer has already covered
+static void build_opaque_pass(window_t *window) {
+    for (int i = window->draw_count - 1; i >= 0; i--) {
+        int index = window->draw_order[i].render;
+        widget_render_t *data = &window->render[index];
+
+        if ((data->flags & WIDGET_RENDER_HIDDEN) || !widget_is_opaque(data) || clip_is_empty(window->world[index].clip))
+            continue;
+
+        window->draw_list.depth = draw_depth(i, window->draw_count);
+
+        build_widget(window, index);
+    }
+}
+
+// a threaded window is judged by the frame the compositor is actually showing
+bool ui_window_is_opaque(window_t *window) {
+    return window->thread ? window->thread->front_opaque : window->opaque;
+}
+
+static bool window_thread_busy(window_t *window) {
+    ui_window_thread_t *thread = window->thread;
+
+    if (!thread)
+        return false;
+
+    pthread_mutex_lock(&thread->lock);
+
+    bool busy = thread->state != UI_THREAD_IDLE;
+
+    pthread_mutex_unlock(&thread->lock);
+
+    return busy;
+}
+
+// the CPU half of a frame: walks the widgets into the window's draw list without any GL
+// calls, so separate windows can be built on separate threads
+void ui_build_window(window_t *window) {
+    if (!window || window->widget_count <= 0 || !window->rendered || window_thread_busy(window))
+        return;
+
+    if (!window->prepared)
+        ui_prepare_window(window);
+
+    window->prepared = false;
+
+    ui_draw_list_t *list = &window->draw_list;
+    bool depth = window->depth_prepass && window->depth_rbo && window->draw_count < UI_DEPTH_MAX_DRAWS;
+
+    draw_list_reset(list);
+
+    list->depth_test = depth;
+    list->opaque = window->opaque;
+
+    if (depth)
+        build_opaque_pass(window);
+
+    list->opaque_cmds = list->cmd_count;
+
+    for (int i = 0; i < window->draw_count;) {
+        widget_draw_t *entry = &window->draw_order[i];
+        widget_render_t *data = &window->render[entry->render];
+        widget_world_t *world = &window->world[entry->render];
+
+        if (clip_is_empty(world->clip)) {
+            i = entry->end;
+
+            continue;
+        }
+
+        if ((data->flags & (WIDGET_RENDER_READY | WIDGET_RENDER_HIDDEN)) == WIDGET_RENDER_READY && !(depth && widget_is_opaque(data))) {
+            list->depth = depth ? draw_depth(i, window->draw_count) : 0.0f;
+
+            build_widget(window, entry->render);
+        }
+
+        const float rect[4] = { world->x, world->y, world->x + data->w, world->y + data->h };
+        float child_clip[4];
+
+        clip_intersect(world->clip, rect, child_clip);
+
+        // children are clipped to this widget, so nothing below it can show once that is empty
+        i = clip_is_empty(child_clip) ? entry->end : i + 1;
+    }
+
+    window->built = true;
+}
+
+static void submit_window(window_t *window, GLuint fbo) {
+    ui_draw_list_t *list = &window->draw_list;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, window->width, window->height);
+
+    GLbitfield clear = list->depth_test ? GL_DEPTH_BUFFER_BIT : 0;
+
+    // an opaque window rewrites every pixel, so the old contents are dropped instead of cleared
+    if (list->opaque)
+        ui_discard_framebuffer(GL_COLOR_ATTACHMENT0);
+    else {
+        glClearColor(0, 0, 0, 0);
+
+        clear |= GL_COLOR_BUFFER_BIT;
+    }
+
+    if (clear) {
+        glClearDepthf(1.0f);
+        glClear(clear);
+    }
+
+    if (list->depth_test) {
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+
+        submit_draws(list, 0, list->opaque_cmds, window->width, window->height);
+
+        glDepthMask(GL_FALSE);
+    }
+
+    submit_draws(list, list->opaque_cmds, list->cmd_count, window->width, window->height);
+
+    // the depth buffer only lives for this pass, so a tiler never has to write it out
+    if (list->depth_test) {
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+
+        ui_discard_framebuffer(GL_DEPTH_ATTACHMENT);
+    }
+}
+
+void ui_gl_draw_window(window_t *window) {
+    submit_window(window, window->fbo);
+}
+
+// hands the built frame to the window's thread; a window still busy with an earlier frame
+// keeps showing the last one it finished and is picked up again on a later frame
+static void queue_window_frame(window_t *window) {
+    ui_window_thread_t *thread = window->thread;
+
+    if (window_thread_busy(window))
+        return;
+
+    if (!window->built)
+        ui_build_window(window);
+
+    window->built = false;
+
+    refresh_widget_textures(window);
+
+    thread->ready = egl_create_sync(egl_display, EGL_SYNC_FENCE_KHR, NULL);
+
+    if (thread->ready == EGL_NO_SYNC_KHR)
+        glFinish();
+    else
+        glFlush();
+
+    pthread_mutex_lock(&thread->lock);
+
+    thread->state = UI_THREAD_QUEUED;
+
+    pthread_cond_signal(&thread->wake);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+// the backend half of a frame, submits the draw list built for this frame (building it first
+// if nothing did), or passes it on to the window's own thread
+void ui_render_window(window_t *window) {
+    if (!window || window->widget_count <= 0 || !window->rendered)
+        return;
+
+    if (window->thread) {
+        queue_window_frame(window);
+
+        return;
+    }
+
+    if (!window->built)
+        ui_build_window(window);
+
+    window->built = false;
+
+    refresh_widget_textures(window);
+
+    ui_backend->draw_window(window);
+}
+
+static bool load_thread_procs() {
+    static int supported = -1;
+
+    if (supported == -1) {
+        const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+
+        egl_create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+        egl_destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+        egl_client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+
+        supported = extensions && strstr(extensions, "EGL_KHR_fence_sync") && strstr(extensions, "EGL_KHR_surfaceless_context") && egl_create_sync && egl_destroy_sync && egl_client_wait_sync;
+
+        if (!supported)
+            printf("  WW: (flux_ui.c) load_thread_procs() -> EGL_KHR_fence_sync or EGL_KHR_surfaceless_context is not available\n");
+    }
+
+    return supported;
+}
+
+static void release_held_buffers(ui_window_thread_t *thread) {
+    for (int i = 0; i < thread->held_count; i++) {
+        eventfd_write(thread->held_releases[i], 1);
+        close(thread->held_releases[i]);
+    }
+
+    thread->held_count = 0;
+}
+
+// waits for the fence the compositor set after its uploads, draws into the back texture and
+// fences the result so the compositor can tell when it is safe to show
+static void thread_render_frame(window_t *window, GLuint fbo, ui_stream_t *stream) {
+    ui_window_thread_t *thread = window->thread;
+    ui_draw_list_t *list = &window->draw_list;
+
+    if (thread->ready != EGL_NO_SYNC_KHR) {
+        egl_client_wait_sync(egl_display, thread->ready, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        egl_destroy_sync(egl_display, thread->ready);
+
+        thread->ready = EGL_NO_SYNC_KHR;
+    }
+
+    ui_stream_begin_frame(stream);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, thread->back_tex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, list->depth_test ? window->depth_rbo : 0);
+
+    submit_window(window, fbo);
+
+    ui_stream_end_frame(stream);
+
+    thread->back_opaque = list->opaque;
+    thread->done = egl_create_sync(egl_display, EGL_SYNC_FENCE_KHR, NULL);
+
+    if (thread->done == EGL_NO_SYNC_KHR)
+        glFinish();
+    else
+        glFlush();
+}
+
+static void *window_thread_main(void *data) {
+    window_t *window = data;
+    ui_window_thread_t *thread = window->thread;
+    ui_stream_t stream;
+    GLuint fbo = 0;
+    sigset_t signals;
+
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    bool ok = eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, thread->context);
+
+    if (!ok)
+        printf("  EE: (flux_ui.c) window_thread_main() -> eglMakeCurrent failed (error: 0x%x)\n", eglGetError());
+    else if (ui_stream_init(&stream, UI_THREAD_STREAM_SIZE, true) != 0)
+        ok = false;
+
+    if (ok) {
+        glGenFramebuffers(1, &fbo);
+
+        batch.stream = &stream;
+    }
+
+    pthread_mutex_lock(&thread->lock);
+
+    thread->running = ok;
+    thread->state = UI_THREAD_IDLE;
+
+    pthread_cond_broadcast(&thread->idle);
+
+    while (thread->running) {
+        if (thread->state != UI_THREAD_QUEUED) {
+            pthread_cond_wait(&thread->wake, &thread->lock);
+
+            continue;
+        }
+
+        pthread_mutex_unlock(&thread->lock);
+
+        thread_render_frame(window, fbo, &stream);
+
+        pthread_mutex_lock(&thread->lock);
+
+        thread->state = UI_THREAD_DONE;
+
+        pthread_cond_broadcast(&thread->idle);
+    }
+
+    pthread_mutex_unlock(&thread->lock);
+
+    if (ok) {
+        batch_release();
+        ui_stream_destroy(&stream);
+        glDeleteFramebuffers(1, &fbo);
+        glFinish();
+    }
+
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    return NULL;
+}
+
+// blocks until the window's thread has no frame in flight, a finished frame that was never
+// shown is dropped
+static void window_thread_drain(window_t *window) {
+    ui_window_thread_t *thread = window->thread;
+
+    pthread_mutex_lock(&thread->lock);
+
+    while (thread->state == UI_THREAD_QUEUED && thread->running)
+        pthread_cond_wait(&thread->idle, &thread->lock);
+
+    thread->state = UI_THREAD_IDLE;
+
+    pthread_mutex_unlock(&thread->lock);
+
+    if (thread->done != EGL_NO_SYNC_KHR) {
+        egl_client_wait_sync(egl_display, thread->done, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+        egl_destroy_sync(egl_display, thread->done);
+
+        thread->done = EGL_NO_SYNC_KHR;
+    }
+
+    release_held_buffers(thread);
+}
+
+static void clear_window_texture(window_t *window, GLuint texture) {
+    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, window->color_tex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void release_window_thread(window_t *window) {
+    ui_window_thread_t *thread = window->thread;
+
+    if (thread->ready != EGL_NO_SYNC_KHR)
+        egl_destroy_sync(egl_display, thread->ready);
+
+    if (thread->done != EGL_NO_SYNC_KHR)
+        egl_destroy_sync(egl_display, thread->done);
+
+    release_held_buffers(thread);
+
+    if (thread->context != EGL_NO_CONTEXT)
+        eglDestroyContext(egl_display, thread->context);
+
+    // the front texture may be either one by now, the main framebuffer goes back to it
+    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, window->color_tex, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteTextures(1, &thread->back_tex);
+
+    pthread_mutex_destroy(&thread->lock);
+    pthread_cond_destroy(&thread->wake);
+    pthread_cond_destroy(&thread->idle);
+
+    free(thread->held_releases);
+    free(thread);
+
+    window->thread = NULL;
+}
+
+static void stop_window_thread(window_t *window) {
+    ui_window_thread_t *thread = window->thread;
+
+    pthread_mutex_lock(&thread->lock);
+
+    thread->running = false;
+
+    pthread_cond_signal(&thread->wake);
+    pthread_mutex_unlock(&thread->lock);
+
+    pthread_join(thread->thread, NULL);
+
+    window_thread_drain(window);
+    release_window_thread(window);
+}
+
+// moves a window's GL submission onto its own thread and context, GLES3 only since the GLES2
+// path sets uniforms on programs that every context shares
+int ui_window_set_threaded(window_t *window, bool enabled) {
+    if (enabled == (window->thread != NULL))
+        return 0;
+
+    if (!enabled) {
+        stop_window_thread(window);
+
+        return 0;
+    }
+
+    if (ui_backend->draw_window != ui_gl_draw_window || gles_version < 3) {
+        printf("  WW: (flux_ui.c) ui_window_set_threaded() -> window threads need GLES 3, rendering on the main thread\n");
+
+        return 1;
+    }
+
+    if (!load_thread_procs())
+        return 1;
+
+    ui_window_thread_t *thread = calloc(1, sizeof(ui_window_thread_t));
+
+    if (!thread) {
+        printf("  EE: (flux_ui.c) ui_window_set_threaded() -> allocation failed for window thread\n");
+
+        return 1;
+    }
+
+    const EGLint context_attrs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, gles_version,
+        EGL_NONE
+    };
+
+    thread->context = eglCreateContext(egl_display, egl_config, egl_context, context_attrs);
+    thread->ready = EGL_NO_SYNC_KHR;
+    thread->done = EGL_NO_SYNC_KHR;
+    thread->back_tex = ui_gl_create_texture(window->width, window->height, UI_TEXTURE_RGBA, NULL);
+    thread->front_opaque = window->opaque;
+
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->wake, NULL);
+    pthread_cond_init(&thread->idle, NULL);
+
+    window->thread = thread;
+
+    if (thread->context == EGL_NO_CONTEXT) {
+        printf("  EE: (flux_ui.c) ui_window_set_threaded() -> eglCreateContext failed (error: 0x%x)\n", eglGetError());
+
+        release_window_thread(window);
+
+        return 1;
+    }
+
+    clear_window_texture(window, thread->back_tex);
+
+    glFlush();
+
+    // the thread reports back once its context is current, until then the window counts as busy
+    thread->running = true;
+    thread->state = UI_THREAD_QUEUED;
+
+    if (pthread_create(&thread->thread, NULL, window_thread_main, window) != 0) {
+        printf("  EE: (flux_ui.c) ui_window_set_threaded() -> failed to create window thread\n");
+
+        release_window_thread(window);
+
+        return 1;
+    }
+
+    pthread_mutex_lock(&thread->lock);
+
+    while (thread->state == UI_THREAD_QUEUED)
+        pthread_cond_wait(&thread->idle, &thread->lock);
+
+    bool started = thread->running;
+
+    pthread_mutex_unlock(&thread->lock);
+
+    if (!started) {
+        pthread_join(thread->thread, NULL);
+        release_window_thread(window);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// shows the frame a window thread last finished, once its fence says the gpu is done with it
+void ui_window_poll(window_t *window) {
+    ui_window_thread_t *thread = window ? window->thread : NULL;
+
+    if (!thread)
+        return;
+
+    pthread_mutex_lock(&thread->lock);
+
+    bool done = thread->state == UI_THREAD_DONE;
+
+    pthread_mutex_unlock(&thread->lock);
+
+    if (!done)
+        return;
+
+    if (thread->done != EGL_NO_SYNC_KHR) {
+        if (egl_client_wait_sync(egl_display, thread->done, 0, 0) != EGL_CONDITION_SATISFIED_KHR)
+            return;
+
+        egl_destroy_sync(egl_display, thread->done);
+
+        thread->done = EGL_NO_SYNC_KHR;
+    }
+
+    GLuint front = window->color_tex;
+
+    window->color_tex = thread->back_tex;
+    thread->back_tex = front;
+    thread->front_opaque = thread->back_opaque;
+
+    release_held_buffers(thread);
+
+    pthread_mutex_lock(&thread->lock);
+
+    thread->state = UI_THREAD_IDLE;
+
+    pthread_mutex_unlock(&thread->lock);
+}
+
+static void destroy_widget(widget_t *widget, widget_arena_t *released);
+
+void ui_gl_destroy_target(window_t *window) {
+    glDeleteFramebuffers(1, &window->fbo);
+    glDeleteTextures(1, &window->color_tex);
+    glDeleteRenderbuffers(1, &window->depth_rbo);
+}
+
+void ui_destroy_window(window_t *window) {
+    if (window->thread)
+        stop_window_thread(window);
+
+    for (int i = 0; i < window->widget_count; i++)
+        destroy_widget(window->widgets[i], &window->arena);
+
+    window->widget_count = 0;
+    window->has_focus = false;
+
+    for (int i = 0; i < window->texture_count; i++)
+        ui_destroy_texture(window, i);
+
+    for (int i = 0; i < window->font_count; i++)
+        ui_destroy_font(window, i);
+
+    ui_backend->destroy_target(window);
+
+    arena_release(&window->arena);
+    free(window->render);
+    free(window->world);
+    free(window->render_widgets);
+    free(window->draw_order);
+    free(window->handles);
+
+    draw_list_release(&window->draw_list);
     free(window);
 }
 
@@ -507,85 +2191,300 @@ unsigned long ui_window_get_id(window_t *window) {
     return window->id;
 }
 
-GLuint ui_window_get_texture(window_t *window) {
-    return window->color_tex;
+void ui_window_set_id(window_t *window, unsigned long id) {
+    window->id = id;
+}
+
+int ui_window_get_widget_count(window_t *window) {
+    return window->widget_count;
+}
+
+int ui_window_get_resource_count(window_t *window) {
+    return window->resource_count;
+}
+
+// the framebuffer keeps its attachment, only the texture storage is reallocated on a resize
+void ui_gl_resize_target(window_t *window) {
+    int width = window->width;
+    int height = window->height;
+
+    glBindTexture(GL_TEXTURE_2D, window->color_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    // both halves of a threaded window start out clear so no stale frame shows at the new size
+    if (window->thread) {
+        glBindTexture(GL_TEXTURE_2D, window->thread->back_tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        clear_window_texture(window, window->color_tex);
+        clear_window_texture(window, window->thread->back_tex);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (window->depth_rbo) {
+        glBindRenderbuffer(GL_RENDERBUFFER, window->depth_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+    }
+}
+
+void ui_window_set_geometry(window_t *window, int x, int y, int width, int height) {
+    window->x = x;
+    window->y = y;
+
+    if (width <= 0 || height <= 0 || (width == window->width && height == window->height))
+        return;
+
+    if (window->thread)
+        window_thread_drain(window);
+
+    window->width = width;
+    window->height = height;
+
+    ui_backend->resize_target(window);
+
+    // top-level clips are the window bounds, so they have to be recomputed
+    for (int i = 0; i < window->render_count; i++) {
+        if (window->render_widgets[i] && window->render[i].parent < 0)
+            window->render[i].flags |= WIDGET_RENDER_MOVED;
+    }
+}
+
+void ui_window_get_geometry(window_t *window, int *x, int *y, int *width, int *height) {
+    *x = window->x;
+    *y = window->y;
+    *width = window->width;
+    *height = window->height;
+}
+
+void ui_gl_attach_depth(window_t *window) {
+    glBindFramebuffer(GL_FRAMEBUFFER, window->fbo);
+
+    attach_depth_buffer(window);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// the depth buffer is attached here on the GL thread, building only checks that it exists;
+// a backend without depth testing leaves it out and the window draws in painter's order
+void ui_window_set_depth_prepass(window_t *window, bool enabled) {
+    if (window->thread)
+        window_thread_drain(window);
+
+    window->depth_prepass = enabled;
+
+    if (enabled && ui_backend->attach_depth)
+        ui_backend->attach_depth(window);
+}
+
+void ui_window_set_opacity(window_t *window, float opacity) {
+    window->opacity = fminf(fmaxf(opacity, 0.0f), 1.0f);
+}
+
+float ui_window_get_opacity(window_t *window) {
+    return window->opacity;
+}
+
+GLuint ui_window_get_texture(window_t *window) {
+    return window->color_tex;
+}
+
+widget_t *ui_window_get_widget(window_t *window, const char *widget_id) {
+    return widget_index_find(&window->widget_index, widget_id, hash_widget_id(widget_id));
+}
+
+widget_t *ui_window_get_widget_by_handle(window_t *window, uint32_t handle) {
+    uint32_t slot_index = (handle & WIDGET_HANDLE_INDEX_MASK) - 1;
+
+    if (handle == 0 || slot_index >= window->handle_count)
+        return NULL;
+
+    widget_handle_slot_t *slot = &window->handles[slot_index];
+
+    if (slot->generation != handle >> WIDGET_HANDLE_INDEX_BITS)
+        return NULL;
+
+    return slot->widget;
 }
 
-widget_t *ui_window_get_widget(window_t *window, const char *widget_id) {
-    for (int i = 0; i < window->widget_count; i++) {
-        widget_t *curr_widg = window->widgets[i];
+widget_t *ui_window_create_widget(window_t *window, const char *id, widget_type_t type) {
+    widget_t *widg = arena_alloc_widget(&window->arena);
 
-        if (strcmp(curr_widg->id, widget_id) == 0)
-            return curr_widg;
-    }
+    if (!widg)
+        return NULL;
 
-    return NULL;
-}
+    int render_index = window_acquire_render(window, widg);
 
-widget_t *ui_create_widget(const char id[64], widget_type_t type) {
-    widget_t *widg = calloc(1, sizeof(widget_t));
-    
-    strcpy(widg->id, id);
+    if (render_index < 0) {
+        arena_free_widget(&window->arena, widg);
+
+        return NULL;
+    }
+
+    strncpy(widg->id, id, sizeof(widg->id) - 1);
+    widg->id_hash = hash_widget_id(widg->id);
     widg->type = type;
-    widg->children = calloc(MAX_CHILDREN, sizeof(widget_t *));
+    widg->window = window;
+    widg->render_index = render_index;
+    widg->arena = &window->arena;
+    widg->children = NULL;
     widg->child_count = 0;
+    widg->child_capacity = 0;
+    widg->child_index.arena = &window->arena;
     widg->parent.type = PARENT_NONE;
-    widg->parent.widget = NULL;
     widg->parent.window = NULL;
 
-    return widg;
-}
+    widget_render_t *data = &window->render[render_index];
 
-window_t *ui_widget_get_window(widget_t *widget) {
-    widget_t *curr_widg = widget;
+    memset(data, 0, sizeof(*data));
 
-    while (curr_widg->parent.type == PARENT_WIDGET)
-        curr_widg = curr_widg->parent.widget;
+    data->color[0] = data->color[1] = data->color[2] = data->color[3] = 1.0f;
+    data->parent = -1;
+    data->type = type;
 
-    if (curr_widg->parent.type == PARENT_WINDOW)
-        return curr_widg->parent.window;
+    if (type == WIDGET_RECT || type == WIDGET_IMAGE)
+        data->flags = WIDGET_RENDER_READY;
 
-    printf("  EE: (flux_ui.c) ui_widget_get_window() -> unable to get window for widget\n");
+    return widg;
+}
 
-    return NULL;
+window_t *ui_widget_get_window(widget_t *widget) {
+    return widget->window;
 }
 
-void ui_destroy_widget(widget_t *widget) {
+// memory owned by the arena being released is skipped, it goes away with the arena in one step
+static void destroy_widget(widget_t *widget, widget_arena_t *released) {
     if (!widget)
         return;
 
-    if (widget->texture) {
-        window_t *widg_win = ui_widget_get_window(widget);
+    widget_render_t *data = widget_render(widget);
+
+    // a frame still in flight on the window's thread can sample the textures and the client's
+    // memory behind them, so they are only let go once it is done
+    if (widget->window->thread && (widget->buffer || widget->dmabuf))
+        window_thread_drain(widget->window);
+
+    if (widget->buffer) {
+        munmap(widget->buffer->pixels, widget->buffer->size);
+        ui_backend->destroy_texture(data->texture);
+        free(widget->buffer);
+
+        widget->buffer = NULL;
+        data->texture = 0;
+    } else if (widget->dmabuf) {
+        for (int i = 0; i < widget->dmabuf->count; i++) {
+            dmabuf_slot_t *slot = &widget->dmabuf->slots[i];
+
+            glDeleteTextures(1, &slot->texture);
+            egl_destroy_image(egl_display, slot->image);
+
+            if (slot->release_fd >= 0) {
+                eventfd_write(slot->release_fd, 1);
+                close(slot->release_fd);
+            }
+        }
+
+        free(widget->dmabuf);
 
-        ui_destroy_texture(widg_win, widget->texture);
+        widget->dmabuf = NULL;
+        data->texture = 0;
     }
 
     for (int i = 0; i < widget->child_count; i++)
-        ui_destroy_widget(widget->children[i]);
+        destroy_widget(widget->children[i], released);
+
+    if (widget->arena == released)
+        return;
 
-    free(widget->children);
-    free(widget);
+    window_release_render(widget->window, widget->render_index);
+    widget_index_destroy(&widget->child_index);
+    widget_free(widget, widget->children, widget->child_capacity * sizeof(widget_t *));
+    widget_free(widget, widget->text, widget->text_capacity);
+    arena_free_widget(widget->arena, widget);
+}
+
+void ui_destroy_widget(widget_t *widget) {
+    destroy_widget(widget, NULL);
 }
 
 void ui_widget_set_geometry(widget_t *widg, float x, float y, float w, float h, float radius) {
+    widget_render_t *data = widget_render(widg);
+
     if (x > -1)
-        widg->x = x;
+        data->x = x;
 
     if (y > -1)
-        widg->y = y;
+        data->y = y;
 
     if (w > -1)
-        widg->w = w;
+        data->w = w;
 
     if (h > -1)
-        widg->h = h;
+        data->h = h;
 
     if (radius > -1)
-        widg->radius = radius;
+        data->radius = radius;
+
+    data->flags |= WIDGET_RENDER_MOVED;
+}
+
+// accepts exactly #RRGGBB or #RRGGBBAA and packs it as 0xRRGGBBAA
+int ui_parse_color(const char *hex, uint32_t *rgba) {
+    if (!hex || hex[0] != '#')
+        return 1;
+
+    uint32_t value = 0;
+    int digits = 0;
+
+    for (const char *p = hex + 1; *p; p++, digits++) {
+        int nibble;
+
+        if (*p >= '0' && *p <= '9')
+            nibble = *p - '0';
+        else if (*p >= 'a' && *p <= 'f')
+            nibble = *p - 'a' + 10;
+        else if (*p >= 'A' && *p <= 'F')
+            nibble = *p - 'A' + 10;
+        else
+            return 1;
+
+        if (digits == 8)
+            return 1;
+
+        value = (value << 4) | nibble;
+    }
+
+    if (digits == 6)
+        value = (value << 8) | 0xff;
+    else if (digits != 8)
+        return 1;
+
+    *rgba = value;
+
+    return 0;
+}
+
+int ui_widget_set_color(widget_t *widg, const char *color) {
+    uint32_t rgba;
+
+    if (ui_parse_color(color, &rgba) != 0) {
+        printf("  WW: (flux_ui.c) ui_widget_set_color() -> invalid color %s\n    widget ID: %s\n", color, widg->id);
+
+        return 1;
+    }
+
+    ui_widget_set_rgba(widg, rgba);
+
+    return 0;
 }
 
-void ui_widget_set_color(widget_t *widg, const char *color) {
-    strcpy(widg->color, color);
+void ui_widget_set_rgba(widget_t *widg, uint32_t rgba) {
+    float *c = widget_render(widg)->color;
+
+    c[0] = ((rgba >> 24) & 0xff) / 255.0f;
+    c[1] = ((rgba >> 16) & 0xff) / 255.0f;
+    c[2] = ((rgba >> 8) & 0xff) / 255.0f;
+    c[3] = (rgba & 0xff) / 255.0f;
 }
 
 void ui_widget_set_text(widget_t *widg, const char *text) {
@@ -595,7 +2494,29 @@ void ui_widget_set_text(widget_t *widg, const char *text) {
         return;
     }
 
-    strcpy(widg->text, text);
+    size_t size = strlen(text) + 1;
+
+    if (size > widg->text_capacity) {
+        char *buffer = widget_alloc(widg, size);
+
+        if (!buffer) {
+            printf("  EE: (flux_ui.c) ui_widget_set_text() -> allocation failed for text\n");
+
+            return;
+        }
+
+        widget_free(widg, widg->text, widg->text_capacity);
+
+        widg->text = buffer;
+        widg->text_capacity = size;
+    }
+
+    memcpy(widg->text, text, size);
+
+    widget_render_t *data = widget_render(widg);
+
+    data->text = widg->text;
+    data->flags |= WIDGET_RENDER_READY;
 }
 
 void ui_widget_set_image(widget_t *widg, int texture) {
@@ -605,23 +2526,30 @@ void ui_widget_set_image(widget_t *widg, int texture) {
         return;
     }
 
-    if (texture < 0 || texture >= MAX_WIDGETS) {
+    window_t *widg_win = widg->window;
+
+    if (texture < 0 || texture >= widg_win->texture_count) {
         printf("  EE: (flux_ui.c) ui_widget_set_image() -> invalid texture index\n");
 
         return;
     }
 
-    window_t *widg_win = ui_widget_get_window(widg);
+    texture_t *tex = &widg_win->textures[texture];
 
-    GLuint tex = widg_win->textures[texture];
-
-    if (tex == -1) {
-        printf("  WW: (flux_ui.c) ui_widget_set_image() -> invalid texture");
+    if (tex->id == (GLuint)-1) {
+        printf("  WW: (flux_ui.c) ui_widget_set_image() -> invalid texture\n");
 
         return;
     }
 
-    widg->texture = tex;
+    widget_render_t *data = widget_render(widg);
+
+    data->texture = tex->id;
+
+    if (tex->opaque)
+        data->flags |= WIDGET_RENDER_OPAQUE_CONTENT;
+    else
+        data->flags &= ~WIDGET_RENDER_OPAQUE_CONTENT;
 }
 
 void ui_widget_set_font(widget_t *widg, window_t *window, int font) {
@@ -631,122 +2559,506 @@ void ui_widget_set_font(widget_t *widg, window_t *window, int font) {
         return;
     }
 
+    if (font < 0 || font >= window->font_count || !window->fonts[font]) {
+        printf("  WW: (flux_ui.c) ui_widget_set_font() -> invalid font index %d\n    widget ID: %s\n", font, widg->id);
+
+        return;
+    }
+
     font_t *widg_font = window->fonts[font];
 
-    widg->font = widg_font;
+    widget_render(widg)->font = widg_font;
+}
+
+int ui_widget_attach_buffer(widget_t *widg, int fd, int width, int height) {
+    if (widg->type != WIDGET_BUFFER || widg->dmabuf) {
+        printf("  WW: (flux_ui.c) ui_widget_attach_buffer() -> widget cannot take a shared memory buffer\n    widget ID: %s\n", widg->id);
+
+        return 1;
+    }
+
+    int max_size = ui_backend->max_texture_size;
+
+    if (width <= 0 || height <= 0 || width > max_size || height > max_size) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_buffer() -> invalid buffer size %dx%d\n", width, height);
+
+        return 1;
+    }
+
+    size_t size = (size_t)width * height * 4;
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size || seals == -1 || !(seals & F_SEAL_SHRINK)) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_buffer() -> buffer must be a sealed memfd of at least %zu bytes\n", size);
+
+        return 1;
+    }
+
+    uint8_t *pixels = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (pixels == MAP_FAILED) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_buffer() -> mmap failed: %s\n", strerror(errno));
+
+        return 1;
+    }
+
+    client_buffer_t *buffer = widg->buffer;
+    widget_render_t *data = widget_render(widg);
+    GLuint texture = ui_backend->create_texture(width, height, UI_TEXTURE_RGBA, pixels);
+
+    if (!texture) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_buffer() -> failed to create a %dx%d texture\n", width, height);
+
+        munmap(pixels, size);
+
+        return 1;
+    }
+
+    if (buffer) {
+        if (widg->window->thread)
+            window_thread_drain(widg->window);
+
+        munmap(buffer->pixels, buffer->size);
+        ui_backend->destroy_texture(data->texture);
+    } else {
+        buffer = calloc(1, sizeof(client_buffer_t));
+
+        if (!buffer) {
+            ui_backend->destroy_texture(texture);
+            munmap(pixels, size);
+
+            return 1;
+        }
+    }
+
+    buffer->pixels = pixels;
+    buffer->size = size;
+    buffer->width = width;
+    buffer->height = height;
+
+    data->texture = texture;
+
+    buffer->damage_x0 = buffer->damage_y0 = 0;
+    buffer->damage_x1 = buffer->damage_y1 = 0;
+
+    widg->buffer = buffer;
+    data->flags = (data->flags | WIDGET_RENDER_READY) & ~WIDGET_RENDER_DAMAGED;
+
+    return 0;
+}
+
+void ui_widget_commit_buffer(widget_t *widg, int x, int y, int w, int h) {
+    client_buffer_t *buffer = widg->buffer;
+
+    if (!buffer) {
+        printf("  WW: (flux_ui.c) ui_widget_commit_buffer() -> widget has no attached buffer\n    widget ID: %s\n", widg->id);
+
+        return;
+    }
+
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    // the rectangle comes straight from the client, so its far edge is worked out in 64 bits
+    int x1 = (w < 0 || (long long)x + w > buffer->width) ? buffer->width : x + w;
+    int y1 = (h < 0 || (long long)y + h > buffer->height) ? buffer->height : y + h;
+
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    widget_render(widg)->flags |= WIDGET_RENDER_DAMAGED;
+
+    if (buffer->damage_x1 <= buffer->damage_x0 || buffer->damage_y1 <= buffer->damage_y0) {
+        buffer->damage_x0 = x0;
+        buffer->damage_y0 = y0;
+        buffer->damage_x1 = x1;
+        buffer->damage_y1 = y1;
+
+        return;
+    }
+
+    if (x0 < buffer->damage_x0)
+        buffer->damage_x0 = x0;
+
+    if (y0 < buffer->damage_y0)
+        buffer->damage_y0 = y0;
+
+    if (x1 > buffer->damage_x1)
+        buffer->damage_x1 = x1;
+
+    if (y1 > buffer->damage_y1)
+        buffer->damage_y1 = y1;
+}
+
+static bool load_dmabuf_procs() {
+    static int supported = -1;
+
+    // the CPU backend runs without an EGL display and has no way to sample a dmabuf
+    if (supported == -1 && egl_display == EGL_NO_DISPLAY) {
+        printf("  WW: (flux_ui.c) load_dmabuf_procs() -> dmabuf import needs the GLES backend\n");
+
+        supported = 0;
+    }
+
+    if (supported == -1) {
+        const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+
+        egl_create_image = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+        egl_destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+        gl_image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+
+        supported = extensions && strstr(extensions, "EGL_EXT_image_dma_buf_import") && egl_create_image && egl_destroy_image && gl_image_target_texture;
+
+        if (!supported)
+            printf("  WW: (flux_ui.c) load_dmabuf_procs() -> EGL_EXT_image_dma_buf_import is not available\n");
+    }
+
+    return supported;
+}
+
+int ui_widget_attach_dmabuf(widget_t *widg, const dmabuf_desc_t *desc, int release_fd) {
+    if (widg->type != WIDGET_BUFFER || widg->buffer) {
+        printf("  WW: (flux_ui.c) ui_widget_attach_dmabuf() -> widget cannot take a dmabuf\n    widget ID: %s\n", widg->id);
+
+        return -1;
+    }
+
+    if (!load_dmabuf_procs())
+        return -1;
+
+    if (desc->width <= 0 || desc->height <= 0) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_dmabuf() -> invalid buffer size %dx%d\n", desc->width, desc->height);
+
+        return -1;
+    }
+
+    if (!widg->dmabuf) {
+        widg->dmabuf = calloc(1, sizeof(dmabuf_set_t));
+
+        if (!widg->dmabuf)
+            return -1;
+
+        widg->dmabuf->current = -1;
+    }
+
+    dmabuf_set_t *set = widg->dmabuf;
+
+    if (set->count >= MAX_DMABUF_SLOTS) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_dmabuf() -> maximum number of dmabuf slots reached\n");
+
+        return -1;
+    }
+
+    EGLint attrs[32];
+    int n = 0;
+
+    attrs[n++] = EGL_WIDTH;
+    attrs[n++] = desc->width;
+    attrs[n++] = EGL_HEIGHT;
+    attrs[n++] = desc->height;
+    attrs[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+    attrs[n++] = desc->fourcc;
+    attrs[n++] = EGL_DMA_BUF_PLANE0_FD_EXT;
+    attrs[n++] = desc->fd;
+    attrs[n++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+    attrs[n++] = desc->offset;
+    attrs[n++] = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+    attrs[n++] = desc->stride;
+
+    if (desc->modifier != DRM_FORMAT_MOD_INVALID) {
+        attrs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+        attrs[n++] = (EGLint)(desc->modifier & 0xffffffff);
+        attrs[n++] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+        attrs[n++] = (EGLint)(desc->modifier >> 32);
+    }
+
+    attrs[n++] = EGL_NONE;
+
+    EGLImageKHR image = egl_create_image(egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attrs);
+
+    if (image == EGL_NO_IMAGE_KHR) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_dmabuf() -> eglCreateImageKHR failed (error: 0x%x)\n", eglGetError());
+
+        return -1;
+    }
+
+    dmabuf_slot_t *slot = &set->slots[set->count];
+
+    glGenTextures(1, &slot->texture);
+    glBindTexture(GL_TEXTURE_2D, slot->texture);
+
+    gl_image_target_texture(GL_TEXTURE_2D, (GLeglImageOES)image);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (glGetError() != GL_NO_ERROR) {
+        printf("  EE: (flux_ui.c) ui_widget_attach_dmabuf() -> format cannot be sampled as GL_TEXTURE_2D\n");
+
+        glDeleteTextures(1, &slot->texture);
+        egl_destroy_image(egl_display, image);
+
+        return -1;
+    }
+
+    slot->image = image;
+    slot->release_fd = release_fd;
+    slot->opaque = desc->fourcc == DRM_FORMAT_XRGB8888 || desc->fourcc == DRM_FORMAT_XBGR8888;
+
+    return set->count++;
+}
+
+int ui_widget_present_dmabuf(widget_t *widg, int slot) {
+    dmabuf_set_t *set = widg->dmabuf;
+
+    if (!set || slot < 0 || slot >= set->count) {
+        printf("  WW: (flux_ui.c) ui_widget_present_dmabuf() -> invalid dmabuf slot %d\n    widget ID: %s\n", slot, widg->id);
+
+        return 1;
+    }
+
+    if (set->current == slot)
+        return 0;
+
+    if (set->current >= 0) {
+        int release_fd = set->slots[set->current].release_fd;
+
+        if (release_fd >= 0) {
+            int **releases = &pending_releases;
+            int *count = &pending_release_count;
+            int *capacity = &pending_release_capacity;
+            ui_window_thread_t *thread = widg->window->thread;
+
+            // a window thread may still be sampling the old buffer, its release waits for that frame
+            if (thread && window_thread_busy(widg->window)) {
+                releases = &thread->held_releases;
+                count = &thread->held_count;
+                capacity = &thread->held_capacity;
+            }
+
+            if (*count == *capacity && !grow_array(NULL, (void **)releases, capacity, *count, sizeof(int), 16))
+                return 1;
+
+            int fd = dup(release_fd);
+
+            if (fd >= 0)
+                (*releases)[(*count)++] = fd;
+        }
+    }
+
+    set->current = slot;
+
+    widget_render_t *data = widget_render(widg);
+
+    data->texture = set->slots[slot].texture;
+    data->flags |= WIDGET_RENDER_READY;
+
+    if (set->slots[slot].opaque)
+        data->flags |= WIDGET_RENDER_OPAQUE_CONTENT;
+    else
+        data->flags &= ~WIDGET_RENDER_OPAQUE_CONTENT;
+
+    return 0;
+}
+
+void ui_flush_dmabuf_releases() {
+    for (int i = 0; i < pending_release_count; i++) {
+        eventfd_write(pending_releases[i], 1);
+        close(pending_releases[i]);
+    }
+
+    pending_release_count = 0;
 }
 
 font_t *ui_widget_get_font(widget_t *widg) {
-    return widg->font;
+    return widget_render(widg)->font;
+}
+
+uint32_t ui_widget_get_handle(widget_t *widg) {
+    return widg->handle;
 }
 
-void ui_widget_append_child(widget_t *widg, widget_t *child) {
+int ui_widget_append_child(widget_t *widg, widget_t *child) {
     if (!widg) {
         printf("  EE: (flux_ui.c) ui_widget_append_child() -> attempted to append to an invalid widget\n");
 
-        exit(1);
+        return 1;
     }
 
     if (!child) {
         printf("  EE: (flux_ui.c) ui_widget_append_child() -> attempted to append an invalid child\n");
 
-        exit(1);
+        return 1;
+    }
+
+    if (child->window != widg->window) {
+        printf("  EE: (flux_ui.c) ui_widget_append_child() -> child %s belongs to another window\n", child->id);
+
+        return 1;
     }
 
     int count = widg->child_count;
 
-    if (count >= MAX_CHILDREN) {
-        printf("  EE: (flux_ui.c) ui_widget_append_child() -> allowed number of children exceeded\n");
+    widget_parent_t widg_parent;
+    widg_parent.type = PARENT_WIDGET;
+    widg_parent.widget = widg;
+
+    widget_t *existing = widget_index_find(&widg->child_index, child->id, child->id_hash);
 
-        exit(1);
+    if (existing == child)
+        return 0;
+
+    if (existing) {
+        widget_index_replace(&widg->child_index, existing, child);
+
+        widg->children[existing->index] = child;
+        child->index = existing->index;
+        child->parent = widg_parent;
+
+        widget_render(child)->parent = widg->render_index;
+        widget_render(child)->flags |= WIDGET_RENDER_MOVED;
+        widget_render(existing)->parent = -1;
+        widg->window->draw_order_dirty = true;
+
+        return 0;
     }
 
-    for (int i = 0; i < count; i++) {
-        widget_t *curr_widg = widg->children[i];
+    if (count == widg->child_capacity) {
+        void *children = widg->children;
 
-        if (strcmp(curr_widg->id, child->id) == 0) {
-            widg->children[i] = child;
+        if (!grow_array(widg->arena, &children, &widg->child_capacity, count, sizeof(widget_t *), 4)) {
+            printf("  EE: (flux_ui.c) ui_widget_append_child() -> failed to grow child list\n");
 
-            return;
+            return 1;
         }
+
+        widg->children = children;
     }
 
-    widget_parent_t widg_parent;
-    widg_parent.type = PARENT_WIDGET;
-    widg_parent.widget = widg;
+    if (!widget_index_insert(&widg->child_index, child)) {
+        printf("  EE: (flux_ui.c) ui_widget_append_child() -> failed to index child %s\n", child->id);
+
+        return 1;
+    }
 
     widg->children[count] = child;
     widg->child_count++;
+    child->index = count;
     child->parent = widg_parent;
+
+    widget_render(child)->parent = widg->render_index;
+    widget_render(child)->flags |= WIDGET_RENDER_MOVED;
+    widg->window->draw_order_dirty = true;
+
+    return 0;
 }
 
-void ui_append_widget(window_t *window, widget_t *widget) {
+int ui_append_widget(window_t *window, widget_t *widget) {
     if (!window) {
         printf("  EE: (flux_ui.c) ui_append_widget() -> attempted to append to an invalid window\n");
 
-        exit(1);
+        return 1;
     }
 
     if (!widget) {
         printf("  EE: (flux_ui.c) ui_append_widget() -> attempted to append an invalid widget\n");
 
-        exit(1);
+        return 1;
+    }
+
+    if (widget->window != window) {
+        printf("  EE: (flux_ui.c) ui_append_widget() -> widget %s belongs to another window\n", widget->id);
+
+        return 1;
     }
 
     int count = window->widget_count;
 
-    if (count >= MAX_WIDGETS) {
-        printf("  EE: (flux_ui.c) ui_append_widget() -> allowed number of widgets exceeded\n");
+    widget_parent_t widg_parent;
+    widg_parent.type = PARENT_WINDOW;
+    widg_parent.window = window;
 
-        exit(1);
-    }
+    widget_t *existing = widget_index_find(&window->widget_index, widget->id, widget->id_hash);
 
-    if (widget->color[0] == '\0')
-        ui_widget_set_color(widget, "#ffffffff");
+    if (existing == widget)
+        return 0;
 
-    for (int i = 0; i < count; i++) {
-        widget_t *curr_widg = window->widgets[i];
+    if (existing) {
+        widget_index_replace(&window->widget_index, existing, widget);
+        window_release_handle(window, existing->handle);
 
-        if (strcmp(curr_widg->id, widget->id) == 0) {
-            window->widgets[i] = widget;
+        window->widgets[existing->index] = widget;
+        widget->index = existing->index;
+        widget->handle = window_acquire_handle(window, widget);
+        widget->parent = widg_parent;
+        window->draw_order_dirty = true;
 
-            return;
+        existing->handle = 0;
+
+        return 0;
+    }
+
+    if (count == window->widget_capacity) {
+        void *widgets = window->widgets;
+
+        if (!grow_array(&window->arena, &widgets, &window->widget_capacity, count, sizeof(widget_t *), 16)) {
+            printf("  EE: (flux_ui.c) ui_append_widget() -> failed to grow widget list\n");
+
+            return 1;
         }
+
+        window->widgets = widgets;
     }
 
-    widget_parent_t widg_parent;
-    widg_parent.type = PARENT_WINDOW;
-    widg_parent.window = window;
+    if (!widget_index_insert(&window->widget_index, widget)) {
+        printf("  EE: (flux_ui.c) ui_append_widget() -> failed to index widget %s\n", widget->id);
+
+        return 1;
+    }
 
     window->widgets[count] = widget;
     window->widget_count++;
+    widget->index = count;
+    widget->handle = window_acquire_handle(window, widget);
     widget->parent = widg_parent;
+    window->draw_order_dirty = true;
+
+    return 0;
 }
 
 void ui_remove_widget(window_t *window, widget_t *widget) {
     if (!window) {
         printf("  EE: (flux_ui.c) ui_remove_widget() -> attempted to remove from an invalid window\n");
 
-        exit(1);
+        return;
     }
 
     if (!widget) {
         printf("  EE: (flux_ui.c) ui_remove_widget() -> attempted to remove an invalid widget\n");
 
-        exit(1);
+        return;
     }
 
+    widget_t *existing = widget_index_find(&window->widget_index, widget->id, widget->id_hash);
+
+    if (!existing)
+        return;
+
     int count = window->widget_count;
+    widget_t *last = window->widgets[count - 1];
 
-    for (int i = 0; i < count; i++) {
-        widget_t *curr_widg = window->widgets[i];
+    window->widgets[existing->index] = last;
+    window->widgets[count - 1] = NULL;
+    window->widget_count--;
+    last->index = existing->index;
 
-        if (strcmp(curr_widg->id, widget->id) == 0) {
-            window->widgets[i] = window->widgets[count - 1];
-            window->widgets[count - 1] = NULL;
-            window->widget_count--;
-        }
-    }
+    widget_index_remove(&window->widget_index, existing);
+    window_release_handle(window, existing->handle);
+
+    existing->handle = 0;
+    window->draw_order_dirty = true;
 }
 
 void ui_request_render(window_t *window) {
@@ -5,16 +5,45 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
 #include "flux_type.h"
+#include "flux_stream.h"
 
-#define MAX_WIDGETS 256
-#define MAX_CHILDREN 32
+#define MAX_DMABUF_SLOTS 4
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_SIZE_CLASSES 8
+#define ARENA_MIN_CLASS 16
+#define ARENA_WIDGETS_PER_BLOCK 64
+#define WIDGET_HANDLE_INDEX_BITS 20
+#define WIDGET_HANDLE_INDEX_MASK ((1u << WIDGET_HANDLE_INDEX_BITS) - 1)
+#define WIDGET_HANDLE_GENERATION_MASK (0xffffffffu >> WIDGET_HANDLE_INDEX_BITS)
+#define WIDGET_RENDER_READY 0x01
+#define WIDGET_RENDER_DAMAGED 0x02
+#define WIDGET_RENDER_MOVED 0x04
+#define WIDGET_RENDER_OPAQUE_CONTENT 0x08
+#define WIDGET_RENDER_HIDDEN 0x10
+#define UI_MAX_OCCLUDERS 8
+#define UI_BATCH_MAX_QUADS 16384
+#define UI_DEPTH_MAX_DRAWS 65000
+#define UI_SHADER_TEXTURE 0x01
+#define UI_SHADER_GLYPH 0x02
+#define UI_SHADER_ROUNDED 0x04
+#define UI_SHADER_VARIANTS 8
+#define UI_FRAME_BINDING 0
+#define UI_DRAW_LIST_MIN_QUADS 256
+#define UI_THREAD_STREAM_SIZE (4 << 20)
+#define UI_TEXTURE_RGBA 0
+#define UI_TEXTURE_ALPHA 1
 
 typedef struct Glyph {
     float u0, v0;
@@ -24,6 +53,11 @@ typedef struct Glyph {
     float w, h;
 } glyph_t;
 
+typedef struct {
+    GLuint id;
+    bool opaque;
+} texture_t;
+
 typedef struct Font {
     GLuint texture;
     glyph_t glyphs[128];
@@ -33,6 +67,129 @@ typedef struct Font {
 typedef struct Window window_t;
 typedef struct Widget widget_t;
 
+// one corner of a batched quad, positions are window pixels with y down
+typedef struct {
+    float x, y;
+    float local_x, local_y;
+    float w, h;
+    float u, v;
+    float radius, depth;
+    GLubyte color[4];
+} ui_vertex_t;
+
+// one batched quad on the GLES3 path, a single write per quad that the vertex shader expands to
+// its corners; rect and uv are the clipped corners, frame is the unclipped origin and size
+typedef struct {
+    float rect[4];
+    float uv[4];
+    float frame[4];
+    float radius, depth;
+    GLubyte color[4];
+} ui_instance_t;
+
+// a compiled variant of the widget program, indexed by its UI_SHADER_* bits
+typedef struct {
+    GLuint program;
+    GLint attr_pos;
+    GLint attr_local;
+    GLint attr_size;
+    GLint attr_uv;
+    GLint attr_color;
+    GLint attr_params;
+    GLint uni_screen_size;
+    GLint uni_tex;
+} ui_shader_t;
+
+// one run of quads in a draw list that goes out as a single draw call
+typedef struct {
+    int first;
+    int count;
+    int variant;
+    GLuint texture;
+    bool blend;
+} ui_draw_cmd_t;
+
+// a window's frame as plain data, built without touching GL so windows can be built in
+// parallel: quads in the layout the active path uploads, the runs over them (the first
+// opaque_cmds of which are the depth pre-pass) and the widgets whose textures need uploading
+typedef struct {
+    void *quads;
+    int quad_count;
+    int quad_capacity;
+    ui_draw_cmd_t *cmds;
+    int cmd_count;
+    int cmd_capacity;
+    int opaque_cmds;
+    int *uploads;
+    int upload_count;
+    int upload_capacity;
+    float depth;
+    bool depth_test;
+    bool opaque;
+} ui_draw_list_t;
+
+typedef enum {
+    UI_THREAD_IDLE,
+    UI_THREAD_QUEUED,
+    UI_THREAD_DONE
+} ui_thread_state_t;
+
+// a window drawn by its own thread on a context shared with the compositor's: the compositor
+// keeps sampling color_tex while the thread renders the next frame into back_tex, and the two
+// are swapped once the fence behind that frame has signalled; ready is the fence the thread
+// waits on so it never reads textures the compositor is still uploading
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    ui_thread_state_t state;
+    bool running;
+    EGLContext context;
+    EGLSyncKHR ready;
+    EGLSyncKHR done;
+    GLuint back_tex;
+    bool front_opaque;
+    bool back_opaque;
+    int *held_releases;
+    int held_count;
+    int held_capacity;
+} ui_window_thread_t;
+
+extern ui_shader_t ui_shaders[UI_SHADER_VARIANTS];
+extern ui_stream_t ui_geometry_stream;
+
+// one window as the compositor stacks it on screen, bottom to top
+typedef struct {
+    window_t *window;
+    int x, y;
+    int width, height;
+    float opacity;
+    bool opaque;
+} ui_layer_t;
+
+// everything that touches pixels goes through the active backend: GLES through EGL, or the
+// CPU rasterizer for machines without a GPU; texture handles are only meaningful to the
+// backend that made them, attach_depth may be NULL when depth testing is not supported
+typedef struct {
+    const char *name;
+    bool instanced;
+    int max_texture_size;
+    GLuint (*create_texture)(int width, int height, int format, const void *pixels);
+    void (*update_texture)(GLuint texture, int x, int y, int width, int height, int row_length, const void *pixels);
+    void (*destroy_texture)(GLuint texture);
+    int (*create_target)(window_t *window);
+    void (*resize_target)(window_t *window);
+    void (*destroy_target)(window_t *window);
+    void (*attach_depth)(window_t *window);
+    void (*draw_window)(window_t *window);
+    void (*begin_frame)();
+    void (*compose)(const ui_layer_t *layers, int count, bool screen_covered);
+    int (*present)();
+} ui_backend_t;
+
+extern const ui_backend_t *ui_backend;
+
 typedef void (*widget_enter_fn)(widget_t *self);
 typedef void (*widget_leave_fn)(widget_t *self);
 typedef void (*widget_button_down_fn)(widget_t *self);
@@ -58,17 +215,117 @@ typedef struct {
     };
 } widget_parent_t;
 
-typedef struct Widget {
+typedef struct {
+    uint8_t *pixels;
+    size_t size;
+    int width, height;
+    int damage_x0, damage_y0;
+    int damage_x1, damage_y1;
+} client_buffer_t;
+
+typedef struct {
+    EGLImageKHR image;
+    GLuint texture;
+    int release_fd;
+    bool opaque;
+} dmabuf_slot_t;
+
+typedef struct {
+    dmabuf_slot_t slots[MAX_DMABUF_SLOTS];
+    int count;
+    int current;
+} dmabuf_set_t;
+
+typedef struct {
+    int fd;
+    int width, height;
+    uint32_t fourcc;
+    uint32_t stride;
+    uint32_t offset;
+    uint64_t modifier;
+} dmabuf_desc_t;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+typedef struct ArenaLarge {
+    struct ArenaLarge *prev;
+    struct ArenaLarge *next;
+} arena_large_t;
+
+// per-window memory: widgets come from their own slab so they stay contiguous, everything else
+// from size-class free lists over bump blocks, and the whole arena is dropped in one call
+typedef struct {
+    arena_block_t *blocks;
+    arena_block_t *widget_blocks;
+    arena_large_t *large;
+    void *free_lists[ARENA_SIZE_CLASSES];
+    widget_t *free_widgets;
+} widget_arena_t;
+
+// open-addressed map from widget id to widget, keyed by the cached id hash
+typedef struct {
+    widget_arena_t *arena;
+    widget_t **slots;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t tombstones;
+} widget_index_t;
+
+typedef struct {
+    widget_t *widget;
+    uint32_t generation;
+    uint32_t next_free;
+} widget_handle_slot_t;
+
+// everything the renderer reads for one widget, kept in a per-window array so a frame
+// streams through 64-byte records instead of chasing widget_t pointers
+typedef struct {
     float x, y, w, h;
-    int radius, border_width;
-    char color[32];
-    char text[256];
-    font_t *font;
+    float radius;
+    float color[4];
     GLuint texture;
+    font_t *font;
+    const char *text;
+    int parent;
+    uint8_t type;
+    uint8_t flags;
+} widget_render_t;
+
+// world-space placement cached per render record, recomputed only below a moved widget;
+// clip is x0, y0, x1, y1 of every ancestor rect and the window intersected together
+typedef struct {
+    float x, y;
+    float clip[4];
+    uint32_t pass;
+} widget_world_t;
+
+// one widget in parent-first draw order, end is where its subtree stops
+typedef struct {
+    int render;
+    int end;
+} widget_draw_t;
+
+typedef struct Widget {
+    window_t *window;
+    int render_index;
+    char *text;
+    size_t text_capacity;
+    client_buffer_t *buffer;
+    dmabuf_set_t *dmabuf;
     char id[64];
+    uint32_t id_hash;
+    uint32_t handle;
+    int index;
     widget_type_t type;
+    widget_arena_t *arena;
     struct Widget **children;
     int child_count;
+    int child_capacity;
+    widget_index_t child_index;
     widget_parent_t parent;
 
     widget_enter_fn on_mouse_enter;
@@ -78,8 +335,33 @@ typedef struct Widget {
 } widget_t;
 
 typedef struct Window {
-    widget_t *widgets[MAX_WIDGETS];
+    widget_arena_t arena;
+    widget_t **widgets;
     int widget_count;
+    int widget_capacity;
+    widget_index_t widget_index;
+
+    widget_render_t *render;
+    widget_world_t *world;
+    widget_t **render_widgets;
+    int render_count;
+    int render_capacity;
+    int free_render;
+    widget_draw_t *draw_order;
+    int draw_count;
+    int draw_capacity;
+    bool draw_order_dirty;
+    uint32_t world_pass;
+    bool prepared;
+    ui_draw_list_t draw_list;
+    bool built;
+    ui_window_thread_t *thread;
+    bool opaque;
+
+    widget_handle_slot_t *handles;
+    uint32_t handle_count;
+    uint32_t handle_capacity;
+    uint32_t free_handle;
     bool has_focus;
     bool rendered;
     unsigned long id;
@@ -87,59 +369,89 @@ typedef struct Window {
     GLuint fbo;
     GLuint color_tex;
     GLuint depth_rbo;
+    bool depth_prepass;
+    int x, y;
     int width, height;
+    float opacity;
 
-    font_t *fonts[MAX_WIDGETS];
-    GLuint textures[MAX_WIDGETS];
+    font_t **fonts;
+    int font_count;
+    int font_capacity;
+    texture_t *textures;
+    int texture_count;
+    int texture_capacity;
+    int resource_count;
 
     window_render_loop_fn render_loop;
     window_exit_fn on_exit;
 } window_t;
 
-inline void ui_hex_to_rgba(const char *hex, float *r, float *g, float *b, float *a) {
-    unsigned int alpha, red, green, blue;
-
-    if (sscanf(hex, "#%2x%2x%2x%2x", &red, &green, &blue, &alpha) != 4) {
-        printf("  WW: hex_to_rgba() -> failed to parse hex string: %s\n", hex);
-
-        return;
-    }
-    
-    *a = alpha / 255.0f;
-    *r = red / 255.0f;
-    *g = green / 255.0f;
-    *b = blue / 255.0f;
-}
-
 int ui_load_texture(window_t *window, const char *filename);
 void ui_destroy_texture(window_t *window, int texture);
 int ui_load_font(window_t *window, const char *ttf_path, float pixel_height);
 void ui_destroy_font(window_t *window, int font);
 
-void ui_draw_rect(float x, float y, float w, float h, float r, float red, float green, float blue, float alpha);
-void ui_draw_rect_texture(float x, float y, float w, float h, float r, float red, float green, float blue, float alpha, GLuint texture);
-void ui_draw_text(float x, float y, font_t *font, const char *text, float r, float g, float b, float a);
+GLuint ui_gl_create_texture(int width, int height, int format, const void *pixels);
+void ui_gl_update_texture(GLuint texture, int x, int y, int width, int height, int row_length, const void *pixels);
+void ui_gl_destroy_texture(GLuint texture);
+int ui_gl_create_target(window_t *window);
+void ui_gl_resize_target(window_t *window);
+void ui_gl_destroy_target(window_t *window);
+void ui_gl_attach_depth(window_t *window);
+void ui_gl_draw_window(window_t *window);
+
+void ui_set_blend(bool enabled);
+void ui_discard_framebuffer(GLenum attachment);
+void ui_draw_rect(ui_draw_list_t *list, float x, float y, float w, float h, float r, const float color[4], const float clip[4]);
+void ui_draw_rect_texture(ui_draw_list_t *list, float x, float y, float w, float h, float r, const float color[4], const float clip[4], GLuint texture, bool opaque_texture);
+void ui_draw_text(ui_draw_list_t *list, float x, float y, font_t *font, const char *text, const float color[4], const float clip[4]);
 void ui_measure_text(window_t *window, const char *text, int font, float *out_width, float *out_height, float *out_visual_min_y);
 
 window_t *ui_create_window();
+void ui_prepare_window(window_t *window);
+bool ui_window_is_opaque(window_t *window);
+void ui_build_window(window_t *window);
 void ui_render_window(window_t *window);
 void ui_destroy_window(window_t *window);
 bool ui_window_get_rendered(window_t *window);
 unsigned long ui_window_get_id(window_t *window);
+void ui_window_set_id(window_t *window, unsigned long id);
+int ui_window_get_widget_count(window_t *window);
+int ui_window_get_resource_count(window_t *window);
+void ui_window_set_geometry(window_t *window, int x, int y, int width, int height);
+void ui_window_get_geometry(window_t *window, int *x, int *y, int *width, int *height);
+void ui_window_set_depth_prepass(window_t *window, bool enabled);
+int ui_window_set_threaded(window_t *window, bool enabled);
+void ui_window_poll(window_t *window);
+void ui_window_set_opacity(window_t *window, float opacity);
+float ui_window_get_opacity(window_t *window);
 GLuint ui_window_get_texture(window_t *window);
 widget_t *ui_window_get_widget(window_t *window, const char *widget_id);
+widget_t *ui_window_get_widget_by_handle(window_t *window, uint32_t handle);
 void ui_call_render_loop(window_t *window, float dt);
 
-widget_t *ui_create_widget(const char *id, widget_type_t type);
+void *ui_window_alloc(window_t *window, size_t size);
+void ui_window_free(window_t *window, void *ptr, size_t size);
+
+widget_t *ui_window_create_widget(window_t *window, const char *id, widget_type_t type);
 void ui_destroy_widget(widget_t *widget);
+window_t *ui_widget_get_window(widget_t *widget);
 void ui_widget_set_geometry(widget_t *widg, float x, float y, float w, float h, float radius);
-void ui_widget_set_color(widget_t *widg, const char *color);
+int ui_parse_color(const char *hex, uint32_t *rgba);
+int ui_widget_set_color(widget_t *widg, const char *color);
+void ui_widget_set_rgba(widget_t *widg, uint32_t rgba);
 void ui_widget_set_text(widget_t *widg, const char *text);
 void ui_widget_set_image(widget_t *widg, int texture);
 void ui_widget_set_font(widget_t *widg, window_t *window, int font);
+int ui_widget_attach_buffer(widget_t *widg, int fd, int width, int height);
+void ui_widget_commit_buffer(widget_t *widg, int x, int y, int w, int h);
+int ui_widget_attach_dmabuf(widget_t *widg, const dmabuf_desc_t *desc, int release_fd);
+int ui_widget_present_dmabuf(widget_t *widg, int slot);
+void ui_flush_dmabuf_releases();
 font_t *ui_widget_get_font(widget_t *widg);
-void ui_widget_append_child(widget_t *widg, widget_t *child);
-void ui_append_widget(window_t *window, widget_t *widget);
+uint32_t ui_widget_get_handle(widget_t *widg);
+int ui_widget_append_child(widget_t *widg, widget_t *child);
+int ui_append_widget(window_t *window, widget_t *widget);
 void ui_remove_widget(window_t *window, widget_t *widget);
 
 void ui_request_render(window_t *window);
@@ -65,35 +65,35 @@ window_t *sys_ui_menu() {
     ui_font_heading = ui_load_font(menu_window, "assets/fonts/roboto.ttf", 48);
     ui_font_body = ui_load_font(menu_window, "assets/fonts/roboto.ttf", 36);
 
-    menu_background = ui_create_widget("menu-background", WIDGET_RECT);
+    menu_background = ui_window_create_widget(menu_window, "menu-background", WIDGET_RECT);
 
     ui_widget_set_geometry(menu_background, 0, 0, mode->hdisplay, mode->vdisplay, 0);
-    ui_widget_set_color(menu_background, "#000000b2");
+    ui_widget_set_rgba(menu_background, 0x000000b2);
     ui_append_widget(menu_window, menu_background);
 
-    menu_body = ui_create_widget("menu-body", WIDGET_RECT);
+    menu_body = ui_window_create_widget(menu_window, "menu-body", WIDGET_RECT);
 
     float menu_y = (mode->vdisplay - 40) - 400;
 
     ui_widget_set_geometry(menu_body, 40, menu_y, mode->hdisplay - 80, 400, 10);
-    ui_widget_set_color(menu_body, "#1c1c1cff");
+    ui_widget_set_rgba(menu_body, 0x1c1c1cff);
     ui_append_widget(menu_window, menu_body);
 
-    menu_clock = ui_create_widget("menu-clock", WIDGET_TEXT);
+    menu_clock = ui_window_create_widget(menu_window, "menu-clock", WIDGET_TEXT);
 
     ui_widget_set_geometry(menu_clock, clock_x, clock_y, 50, 50, -1);
-    ui_widget_set_color(menu_clock, "#ffffffff");
+    ui_widget_set_rgba(menu_clock, 0xffffffff);
     ui_widget_set_font(menu_clock, menu_window, ui_font_heading);
     ui_widget_set_text(menu_clock, "CLOCK");
     ui_append_widget(menu_window, menu_clock);
 
-    menu_test_button = ui_create_widget("menu-test-button", WIDGET_RECT);
+    menu_test_button = ui_window_create_widget(menu_window, "menu-test-button", WIDGET_RECT);
 
     ui_widget_set_geometry(menu_test_button, 100, menu_y + 60, 200, 80, 10);
-    ui_widget_set_color(menu_test_button, "#000000ff");
+    ui_widget_set_rgba(menu_test_button, 0x000000ff);
     ui_append_widget(menu_window, menu_test_button);
 
-    menu_test_text = ui_create_widget("menu-test-text", WIDGET_TEXT);
+    menu_test_text = ui_window_create_widget(menu_window, "menu-test-text", WIDGET_TEXT);
 
     float width, height, visual_min_y;
 
@@ -103,7 +103,7 @@ window_t *sys_ui_menu() {
     text_y = (80 - height) / 2 - visual_min_y;
 
     ui_widget_set_geometry(menu_test_text, text_x, text_y, width, height, 0);
-    ui_widget_set_color(menu_test_text, "#ffffffff");
+    ui_widget_set_rgba(menu_test_text, 0xffffffff);
     ui_widget_set_font(menu_test_text, menu_window, ui_font_body);
     ui_widget_set_text(menu_test_text, "Test");
     ui_widget_append_child(menu_test_button, menu_test_text);
@@ -127,13 +127,13 @@ window_t *sys_ui_init() {
     ui_font_body = ui_load_font(sys_window, "assets/fonts/roboto.ttf", 32);
     ui_font_heading = ui_load_font(sys_window, "assets/fonts/roboto.ttf", 48);
 
-    sys_background = ui_create_widget("sys-background", WIDGET_RECT);
+    sys_background = ui_window_create_widget(sys_window, "sys-background", WIDGET_RECT);
 
     ui_widget_set_geometry(sys_background, 0, 0, mode->hdisplay, mode->vdisplay, 0);
-    ui_widget_set_color(sys_background, "#1c1c1cff");
+    ui_widget_set_rgba(sys_background, 0x1c1c1cff);
     ui_append_widget(sys_window, sys_background);
 
-    sys_clock = ui_create_widget("sys-clock", WIDGET_TEXT);
+    sys_clock = ui_window_create_widget(sys_window, "sys-clock", WIDGET_TEXT);
 
     float width, height;
 
@@ -143,15 +143,15 @@ window_t *sys_ui_init() {
     clock_y = height + 20;
 
     ui_widget_set_geometry(sys_clock, clock_x, clock_y, 50, 50, -1);
-    ui_widget_set_color(sys_clock, "#ffffffff");
+    ui_widget_set_rgba(sys_clock, 0xffffffff);
     ui_widget_set_font(sys_clock, sys_window, ui_font_heading);
     ui_widget_set_text(sys_clock, "CLOCK");
     ui_append_widget(sys_window, sys_clock);
 
-    sys_recent_game = ui_create_widget("sys-recent-game", WIDGET_IMAGE);
+    sys_recent_game = ui_window_create_widget(sys_window, "sys-recent-game", WIDGET_IMAGE);
 
     ui_widget_set_geometry(sys_recent_game, 100, 100, 300, 300, 10);
-    ui_widget_set_color(sys_recent_game, "#ffffffff");
+    ui_widget_set_rgba(sys_recent_game, 0xffffffff);
     
     ui_game_image = ui_load_texture(sys_window, "assets/test.jpg");
 
@@ -3,6 +3,13 @@
 
 unsigned long win_id = -1;
 int width, height;
+int pipeline_errors = 0;
+
+void count_error(uint32_t seq, int status, const char *message) {
+    printf("test.c: request %u failed: %s\n", seq, message);
+
+    pipeline_errors++;
+}
 
 int main() {
     printf("test.c: initializing API...\n");
@@ -40,6 +47,25 @@ int main() {
     flux_set_widget_color(win_id, "square", "#ff0000ff");
     flux_set_widget_geometry(win_id, "square", 0, 0, width, height, 10, -1);
 
+    // setters queued right behind an async create have to find the widget it creates
+    flux_set_error_handler(count_error);
+    flux_enable_ring(0);
+
+    flux_handle_t created = flux_create_widget_async(win_id, "pipelined", WIDGET_RECT);
+
+    flux_set_widget_geometry(win_id, "pipelined", 20, 20, 100, 100, 10, -1);
+    flux_set_widget_rgba(win_id, "pipelined", FLUX_RGBA(0, 255, 0, 255));
+
+    flux_widget_t pipelined = 0;
+
+    if (flux_wait(created, &pipelined, sizeof(pipelined)) != 0 || flux_sync() != 0 || pipelined == 0 || pipeline_errors > 0) {
+        printf("test.c: pipelined widget setup failed\n");
+
+        flux_shutdown(win_id);
+
+        return 1;
+    }
+
     flux_render_window(win_id);
 
     sleep(3);